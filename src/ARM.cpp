@@ -17,10 +17,12 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
 #include "ARMInterpreter.h"
+#include "ARM_InstrInfo.h"
 #include "Config.h"
 #include "AREngine.h"
 #include "ARMJIT.h"
@@ -112,10 +114,14 @@ void ARM::Reset()
 
     CodeMem.Mem = NULL;
 
+    for (u32 i = 0; i < IdleLoopCacheSize; i++)
+        IdleLoopCache[i].Count = 0;
+
 #ifdef JIT_ENABLED
     FastBlockLookup = NULL;
     FastBlockLookupStart = 0;
     FastBlockLookupSize = 0;
+    DecodedPos = NULL;
 #endif
 
     // zorp
@@ -172,6 +178,28 @@ void ARMv4::Reset()
     ARM::Reset();
 }
 
+void ARMv4::SetParallelBus(bool parallel)
+{
+    if (parallel)
+    {
+        BusRead8 = NDS::ParallelARM7Read8;
+        BusRead16 = NDS::ParallelARM7Read16;
+        BusRead32 = NDS::ParallelARM7Read32;
+        BusWrite8 = NDS::ParallelARM7Write8;
+        BusWrite16 = NDS::ParallelARM7Write16;
+        BusWrite32 = NDS::ParallelARM7Write32;
+    }
+    else
+    {
+        BusRead8 = NDS::ARM7Read8;
+        BusRead16 = NDS::ARM7Read16;
+        BusRead32 = NDS::ARM7Read32;
+        BusWrite8 = NDS::ARM7Write8;
+        BusWrite16 = NDS::ARM7Write16;
+        BusWrite32 = NDS::ARM7Write32;
+    }
+}
+
 
 void ARM::DoSavestate(Savestate* file)
 {
@@ -243,8 +271,81 @@ void ARM::SetupCodeMem(u32 addr)
     }
 }
 
+bool ARM::PeekCode(u32 addr, bool thumb, u32* instr)
+{
+    NDS::MemRegion region;
+
+    if (!Num)
+    {
+        ARMv5* arm9 = (ARMv5*)this;
+        if (addr < arm9->ITCMSize)
+        {
+            region.Mem = arm9->ITCM;
+            region.Mask = ITCMPhysicalSize - 1;
+        }
+        else if (!arm9->GetMemRegion(addr, false, &region))
+            return false;
+    }
+    else if (NDS::ConsoleType == 1)
+    {
+        if (!DSi::ARM7GetMemRegion(addr, false, &region))
+            return false;
+    }
+    else
+    {
+        if (!NDS::ARM7GetMemRegion(addr, false, &region))
+            return false;
+    }
+
+    u8* ptr = &region.Mem[addr & region.Mask];
+    *instr = thumb ? *(u16*)ptr : *(u32*)ptr;
+    return true;
+}
+
+void ARM::CheckIdleLoop(u32 addr, u32 target)
+{
+    // same rules as the JIT: a short loop whose iterations don't depend on
+    // each other will spin until something else changes, so we can skip
+    // straight to the next target
+    bool thumb = CPSR & 0x20;
+    u32 size = thumb ? 2 : 4;
+    u32 count = ((addr - target) / size) + 1;
+    if (count > IdleLoopMaxInstrs) return;
+
+    // only look at code that can be read without side effects
+    u32 instrs[IdleLoopMaxInstrs];
+    for (u32 i = 0; i < count; i++)
+    {
+        if (!PeekCode(target + i*size, thumb, &instrs[i]))
+            return;
+    }
+
+    // the loop is analyzed again if the code changed since last time
+    u32 key = addr | (thumb ? 1 : 0);
+    IdleLoopEntry& entry = IdleLoopCache[(addr >> 1) & (IdleLoopCacheSize - 1)];
+    if (entry.Addr != key || entry.Count != count || memcmp(entry.Instrs, instrs, count*sizeof(u32)))
+    {
+        ARMInstrInfo::Info info[IdleLoopMaxInstrs];
+        for (u32 i = 0; i < count; i++)
+            info[i] = ARMInstrInfo::Decode(thumb, Num, instrs[i]);
+
+        entry.Addr = key;
+        entry.Count = count;
+        memcpy(entry.Instrs, instrs, count*sizeof(u32));
+        entry.Idle = ARMInstrInfo::IsIdleLoop(thumb, info, count);
+    }
+
+    if (entry.Idle)
+        IdleLoop = 1;
+}
+
 void ARMv5::JumpTo(u32 addr, bool restorecpsr)
 {
+#ifdef JIT_ENABLED
+    // leaves the decode cache block
+    DecodedPos = NULL;
+#endif
+
     if (restorecpsr)
     {
         RestoreCPSR();
@@ -314,6 +415,11 @@ void ARMv5::JumpTo(u32 addr, bool restorecpsr)
 
 void ARMv4::JumpTo(u32 addr, bool restorecpsr)
 {
+#ifdef JIT_ENABLED
+    // leaves the decode cache block
+    DecodedPos = NULL;
+#endif
+
     if (restorecpsr)
     {
         RestoreCPSR();
@@ -558,6 +664,32 @@ void ARMv5::Execute()
 
     while (NDS::ARM9Timestamp < NDS::ARM9Target)
     {
+#ifdef JIT_ENABLED
+        if (!DecodedPos && ARMJIT::DecodeCacheActive)
+            DecodedPos = ARMJIT::LookUpDecodedBlock(this);
+
+        if (DecodedPos)
+        {
+            // same as below, with the fetches and lookups done ahead of time
+            ARMJIT::DecodedInstr* instr = DecodedPos;
+            R[15] += (CPSR & 0x20) ? 2 : 4;
+            CurInstr = instr->Instr;
+            NextInstr[0] = instr[1].Instr;
+            NextInstr[1] = instr[2].Instr;
+            if (instr->CodeFetch) CodeFetchCycles(R[15]);
+            else                  CodeCycles = 0;
+
+            if (CheckCondition(instr->Cond))
+                instr->Handler(this);
+            else
+                AddCycles_C();
+
+            // JumpTo leaves the block
+            if (DecodedPos == instr)
+                DecodedPos = instr[1].Handler ? instr + 1 : NULL;
+        }
+        else
+#endif
         if (CPSR & 0x20) // THUMB
         {
             // prefetch
@@ -594,25 +726,46 @@ void ARMv5::Execute()
         }
  
         // TODO optimize this shit!!!
-        if (Halted)
+        if (StopExecution)
         {
-            if (Halted == 1 && NDS::ARM9Timestamp < NDS::ARM9Target)
+            if (Halted)
             {
-                NDS::ARM9Timestamp = NDS::ARM9Target;
+                if (Halted == 1 && NDS::ARM9Timestamp < NDS::ARM9Target)
+                {
+                    NDS::ARM9Timestamp = NDS::ARM9Target;
+                }
+                break;
+            }
+            if (IdleLoop)
+            {
+                IdleLoop = 0;
+
+                // unless an IRQ is about to end the loop
+                if (!(IRQ && !(CPSR & 0x80)) && NDS::ARM9Timestamp < NDS::ARM9Target)
+                {
+                    NDS::IdleSkipCycles[0] += NDS::ARM9Target - NDS::ARM9Timestamp;
+                    NDS::ARM9Timestamp = NDS::ARM9Target;
+                    Cycles = 0;
+                    break;
+                }
             }
-            break;
+            /*if (NDS::IF[0] & NDS::IE[0])
+            {
+                if (NDS::IME[0] & 0x1)
+                    TriggerIRQ();
+            }*/
+            if (IRQ) TriggerIRQ();
         }
-        /*if (NDS::IF[0] & NDS::IE[0])
-        {
-            if (NDS::IME[0] & 0x1)
-                TriggerIRQ();
-        }*/
-        if (IRQ) TriggerIRQ();
 
         NDS::ARM9Timestamp += Cycles;
         Cycles = 0;
     }
 
+#ifdef JIT_ENABLED
+    // memory can change until the next time
+    DecodedPos = NULL;
+#endif
+
     if (Halted == 2)
         Halted = 0;
 }
@@ -708,6 +861,30 @@ void ARMv4::Execute()
 
     while (NDS::ARM7Timestamp < NDS::ARM7Target)
     {
+#ifdef JIT_ENABLED
+        if (!DecodedPos && ARMJIT::DecodeCacheActive)
+            DecodedPos = ARMJIT::LookUpDecodedBlock(this);
+
+        if (DecodedPos)
+        {
+            // same as below, with the fetches and lookups done ahead of time
+            ARMJIT::DecodedInstr* instr = DecodedPos;
+            R[15] += (CPSR & 0x20) ? 2 : 4;
+            CurInstr = instr->Instr;
+            NextInstr[0] = instr[1].Instr;
+            NextInstr[1] = instr[2].Instr;
+
+            if (CheckCondition(instr->Cond))
+                instr->Handler(this);
+            else
+                AddCycles_C();
+
+            // JumpTo leaves the block
+            if (DecodedPos == instr)
+                DecodedPos = instr[1].Handler ? instr + 1 : NULL;
+        }
+        else
+#endif
         if (CPSR & 0x20) // THUMB
         {
             // prefetch
@@ -739,25 +916,46 @@ void ARMv4::Execute()
         }
 
         // TODO optimize this shit!!!
-        if (Halted)
+        if (StopExecution)
         {
-            if (Halted == 1 && NDS::ARM7Timestamp < NDS::ARM7Target)
+            if (Halted)
+            {
+                if (Halted == 1 && NDS::ARM7Timestamp < NDS::ARM7Target)
+                {
+                    NDS::ARM7Timestamp = NDS::ARM7Target;
+                }
+                break;
+            }
+            if (IdleLoop)
             {
-                NDS::ARM7Timestamp = NDS::ARM7Target;
+                IdleLoop = 0;
+
+                // unless an IRQ is about to end the loop
+                if (!(IRQ && !(CPSR & 0x80)) && NDS::ARM7Timestamp < NDS::ARM7Target)
+                {
+                    NDS::IdleSkipCycles[1] += NDS::ARM7Target - NDS::ARM7Timestamp;
+                    NDS::ARM7Timestamp = NDS::ARM7Target;
+                    Cycles = 0;
+                    break;
+                }
             }
-            break;
+            /*if (NDS::IF[1] & NDS::IE[1])
+            {
+                if (NDS::IME[1] & 0x1)
+                    TriggerIRQ();
+            }*/
+            if (IRQ) TriggerIRQ();
         }
-        /*if (NDS::IF[1] & NDS::IE[1])
-        {
-            if (NDS::IME[1] & 0x1)
-                TriggerIRQ();
-        }*/
-        if (IRQ) TriggerIRQ();
 
         NDS::ARM7Timestamp += Cycles;
         Cycles = 0;
     }
 
+#ifdef JIT_ENABLED
+    // memory can change until the next time
+    DecodedPos = NULL;
+#endif
+
     if (Halted == 2)
         Halted = 0;
 
@@ -35,9 +35,19 @@ enum
     RWFlags_ForceUser = (1<<21),
 };
 
+#ifdef JIT_ENABLED
+namespace ARMJIT
+{
+struct DecodedInstr;
+}
+#endif
+
 const u32 ITCMPhysicalSize = 0x8000;
 const u32 DTCMPhysicalSize = 0x4000;
 
+const u32 IdleLoopMaxInstrs = 8;
+const u32 IdleLoopCacheSize = 64;
+
 class ARM
 {
 public:
@@ -99,6 +109,13 @@ public:
 
     void SetupCodeMem(u32 addr);
 
+    // reads an instruction from where it would be fetched from, without side effects
+    // returns false if it isn't in plain memory
+    bool PeekCode(u32 addr, bool thumb, u32* instr);
+
+    // called by the interpreter when a conditional branch jumps backwards
+    void CheckIdleLoop(u32 addr, u32 target);
+
 
     virtual void DataRead8(u32 addr, u32* val) = 0;
     virtual void DataRead16(u32 addr, u32* val) = 0;
@@ -149,9 +166,22 @@ public:
 
     NDS::MemRegion CodeMem;
 
+    // idle loops found by the interpreter, with the code they were found in
+    struct IdleLoopEntry
+    {
+        u32 Addr; // bit0: THUMB
+        u32 Count;
+        u32 Instrs[IdleLoopMaxInstrs];
+        bool Idle;
+    };
+    IdleLoopEntry IdleLoopCache[IdleLoopCacheSize];
+
 #ifdef JIT_ENABLED
     u32 FastBlockLookupStart, FastBlockLookupSize;
     u64* FastBlockLookup;
+
+    // next instruction of the decode cache block the interpreter is in
+    ARMJIT::DecodedInstr* DecodedPos;
 #endif
 
     static u32 ConditionTable[16];
@@ -191,6 +221,8 @@ public:
 
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
+    // timing of CodeRead32 without the read, for already fetched code
+    void CodeFetchCycles(u32 addr);
 
     void DataRead8(u32 addr, u32* val);
     void DataRead16(u32 addr, u32* val);
@@ -310,6 +342,9 @@ public:
 
     void Reset();
 
+    // switch to the restricted bus used while running on the ARM7 thread
+    void SetParallelBus(bool parallel);
+
     void FillPipeline();
 
     void JumpTo(u32 addr, bool restorecpsr = false);
@@ -2,7 +2,8 @@
 
 #include <string.h>
 #include <assert.h>
-#include <unordered_map>
+#include <algorithm>
+#include <vector>
 
 #define XXH_STATIC_LINKING_ONLY
 #include "xxhash/xxhash.h"
@@ -24,6 +25,7 @@
 #include "SPU.h"
 #include "Wifi.h"
 #include "NDSCart.h"
+#include "Platform.h"
 
 #include "ARMJIT_x64/ARMJIT_Offsets.h"
 static_assert(offsetof(ARM, CPSR) == ARM_CPSR_offset);
@@ -39,13 +41,267 @@ namespace ARMJIT
 Compiler* JITCompiler;
 
 
-std::unordered_map<u32, JitBlock*> JitBlocks9;
-std::unordered_map<u32, JitBlock*> JitBlocks7;
+/*
+    BlockTable
+        - open addressing hash table of blocks, the key is a member of the block
+        - linear probing, entries are shifted back on removal, so there are no tombstones
+        - only allocates when it grows
+*/
+template <u32 JitBlock::* Key>
+struct BlockTable
+{
+    JitBlock** Entries = NULL;
+    u32 Capacity = 0;
+    u32 Count = 0;
+    u32 Shift = 32;
+
+    ~BlockTable()
+    {
+        delete[] Entries;
+    }
+
+    u32 Slot(u32 key)
+    {
+        // fibonacci hashing, the top bits are the best mixed
+        return (key * 0x9E3779B1) >> Shift;
+    }
+
+    JitBlock* Find(u32 key)
+    {
+        if (Count == 0)
+            return NULL;
+
+        for (u32 i = Slot(key);; i = (i + 1) & (Capacity - 1))
+        {
+            JitBlock* block = Entries[i];
+            if (!block || block->*Key == key)
+                return block;
+        }
+    }
+
+    // returns the block which was previously stored under the same key
+    JitBlock* Insert(JitBlock* block)
+    {
+        if ((Count + 1) * 4 > Capacity * 3)
+            Grow();
+
+        u32 key = block->*Key;
+        for (u32 i = Slot(key);; i = (i + 1) & (Capacity - 1))
+        {
+            JitBlock* other = Entries[i];
+            if (!other)
+            {
+                Entries[i] = block;
+                Count++;
+                return NULL;
+            }
+            if (other->*Key == key)
+            {
+                Entries[i] = block;
+                return other;
+            }
+        }
+    }
+
+    JitBlock* Remove(u32 key)
+    {
+        if (Count == 0)
+            return NULL;
+
+        u32 i = Slot(key);
+        for (;; i = (i + 1) & (Capacity - 1))
+        {
+            if (!Entries[i])
+                return NULL;
+            if (Entries[i]->*Key == key)
+                break;
+        }
+
+        JitBlock* block = Entries[i];
+        Count--;
+
+        // move back following entries which would become unreachable
+        u32 j = i;
+        for (;;)
+        {
+            j = (j + 1) & (Capacity - 1);
+            if (!Entries[j])
+                break;
 
-std::unordered_map<u32, JitBlock*> RestoreCandidates;
+            u32 home = Slot(Entries[j]->*Key);
+            if (((j - home) & (Capacity - 1)) >= ((j - i) & (Capacity - 1)))
+            {
+                Entries[i] = Entries[j];
+                i = j;
+            }
+        }
+        Entries[i] = NULL;
+
+        return block;
+    }
+
+    void Grow()
+    {
+        JitBlock** oldEntries = Entries;
+        u32 oldCapacity = Capacity;
+
+        Capacity = Capacity ? Capacity * 2 : 1024;
+        Shift = 32 - __builtin_ctz(Capacity);
+        Entries = new JitBlock*[Capacity];
+        memset(Entries, 0, Capacity * sizeof(JitBlock*));
+        Count = 0;
+
+        for (u32 i = 0; i < oldCapacity; i++)
+        {
+            if (oldEntries[i])
+                Insert(oldEntries[i]);
+        }
+        delete[] oldEntries;
+    }
+
+    void Clear()
+    {
+        if (Count)
+            memset(Entries, 0, Capacity * sizeof(JitBlock*));
+        Count = 0;
+    }
+};
+
+// blocks by start address, for the blocks which can't be found
+// through the fast lookup table (ie. other mirrors)
+BlockTable<&JitBlock::StartAddr> JitBlocks9;
+BlockTable<&JitBlock::StartAddr> JitBlocks7;
+
+BlockTable<&JitBlock::InstrHash> RestoreCandidates;
+
+// blocks are allocated in slabs, and freed ones are reused
+const u32 BlockSlabSize = 1024;
+std::vector<JitBlock*> BlockSlabs;
+std::vector<JitBlock*> FreeBlocks;
+
+JitBlock* AllocJitBlock(u32 num, u32 numAddresses, u32 numLiterals)
+{
+    if (FreeBlocks.empty())
+    {
+        JitBlock* slab = new JitBlock[BlockSlabSize];
+        for (u32 i = 0; i < BlockSlabSize; i++)
+        {
+            slab[i].Index = BlockSlabs.size() * BlockSlabSize + i;
+            FreeBlocks.push_back(&slab[BlockSlabSize - 1 - i]);
+        }
+        BlockSlabs.push_back(slab);
+    }
+
+    JitBlock* block = FreeBlocks.back();
+    FreeBlocks.pop_back();
+    block->Init(num, numAddresses, numLiterals);
+    return block;
+}
+
+void FreeJitBlock(JitBlock* block)
+{
+    if (block->Decoded.Length)
+    {
+        // the interpreter might be in the middle of this block
+        ARM* cpu = block->Num == 0 ? (ARM*)NDS::ARM9 : (ARM*)NDS::ARM7;
+        if (cpu->DecodedPos >= block->Decoded.Data
+            && cpu->DecodedPos < block->Decoded.Data + block->Decoded.Length)
+            cpu->DecodedPos = NULL;
+    }
+
+    FreeBlocks.push_back(block);
+}
 
 TinyVector<u32> InvalidLiterals;
 
+/*
+    VolatileLiterals
+        - literal addresses which have been written to after a block baked them in
+        - unlike InvalidLiterals these are never consumed, they're kept per ROM
+        and stored on disk, so that the next session doesn't have to find them again
+        through a compile/invalidate/recompile cycle
+*/
+TinyVector<u32> VolatileLiterals;
+u32 VolatileLiteralsCRC = 0;
+u32 VolatileLiteralsConfig = 0;
+bool VolatileLiteralsDirty = false;
+
+const u32 kLiteralCacheMagic = 0x434C4A4D; // MJLC
+const u32 kLiteralCacheVersion = 2;
+const u32 kLiteralCacheMax = 0x1000;
+
+bool IsVolatileLiteral(u32 localAddr)
+{
+    return Config::JIT_PersistentCache && VolatileLiterals.Find(localAddr) != -1;
+}
+
+u32 LiteralCacheConfig()
+{
+    // the blocks, and so the literals they bake in, depend on these settings
+    return (Config::JIT_MaxBlockSize & 0xFF)
+        | ((Config::JIT_LiteralOptimisations ? 1 : 0) << 8)
+        | ((Config::JIT_BranchOptimisations ? 1 : 0) << 9)
+        | ((Config::JIT_FastMemory ? 1 : 0) << 10)
+        | ((Config::JIT_TieredCompilation ? 1 : 0) << 11);
+}
+
+void LiteralCachePath(char* path, u32 crc, u32 config)
+{
+    sprintf(path, "jitcache_%08X_%04X.bin", crc, config);
+}
+
+void LoadLiteralCache(u32 crc)
+{
+    VolatileLiterals.Clear();
+    VolatileLiteralsCRC = crc;
+    VolatileLiteralsConfig = LiteralCacheConfig();
+    VolatileLiteralsDirty = false;
+
+    if (!Config::JIT_PersistentCache || !crc)
+        return;
+
+    char path[64];
+    LiteralCachePath(path, crc, VolatileLiteralsConfig);
+    FILE* f = Platform::OpenLocalFile(path, "rb");
+    if (!f)
+        return;
+
+    u32 header[5];
+    if (fread(header, sizeof(header), 1, f) == 1
+        && header[0] == kLiteralCacheMagic
+        && header[1] == kLiteralCacheVersion
+        && header[2] == crc
+        && header[3] == VolatileLiteralsConfig
+        && header[4] <= kLiteralCacheMax)
+    {
+        VolatileLiterals.SetLength(header[4]);
+        if (header[4] && fread(VolatileLiterals.Data, sizeof(u32) * header[4], 1, f) != 1)
+            VolatileLiterals.Clear();
+    }
+
+    fclose(f);
+}
+
+void SaveLiteralCache()
+{
+    if (!Config::JIT_PersistentCache || !VolatileLiteralsDirty || !VolatileLiteralsCRC)
+        return;
+
+    char path[64];
+    LiteralCachePath(path, VolatileLiteralsCRC, VolatileLiteralsConfig);
+    FILE* f = Platform::OpenLocalFile(path, "wb");
+    if (!f)
+        return;
+
+    u32 header[5] = {kLiteralCacheMagic, kLiteralCacheVersion, VolatileLiteralsCRC, VolatileLiteralsConfig, VolatileLiterals.Length};
+    fwrite(header, sizeof(header), 1, f);
+    if (VolatileLiterals.Length)
+        fwrite(VolatileLiterals.Data, sizeof(u32) * VolatileLiterals.Length, 1, f);
+    fclose(f);
+
+    VolatileLiteralsDirty = false;
+}
+
 AddressRange CodeIndexITCM[ITCMPhysicalSize / 512];
 AddressRange CodeIndexMainRAM[NDS::MainRAMMaxSize / 512];
 AddressRange CodeIndexSWRAM[NDS::SharedWRAMSize / 512];
@@ -298,9 +554,19 @@ void Init()
 
 void DeInit()
 {
+    SaveLiteralCache();
+
     ARMJIT_Memory::DeInit();
 
     delete JITCompiler;
+
+    JitBlocks9.Clear();
+    JitBlocks7.Clear();
+    RestoreCandidates.Clear();
+    for (JitBlock* slab : BlockSlabs)
+        delete[] slab;
+    BlockSlabs.clear();
+    FreeBlocks.clear();
 }
 
 void Reset()
@@ -418,33 +684,13 @@ bool DecodeBranch(bool thumb, const FetchedInstr& instr, u32& cond, bool hasLink
 
 bool IsIdleLoop(bool thumb, FetchedInstr* instrs, int instrsCount)
 {
-    // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
-    // it basically checks if one iteration of a loop depends on another
-    // the rules are quite simple
-
     JIT_DEBUGPRINT("checking potential idle loop\n");
-    u16 regsWrittenTo = 0;
-    u16 regsDisallowedToWrite = 0;
-    for (int i = 0; i < instrsCount; i++)
-    {
-        JIT_DEBUGPRINT("instr %d %08x regs(%x %x) %x %x\n", i, instrs[i].Instr, instrs[i].Info.DstRegs, instrs[i].Info.SrcRegs, regsWrittenTo, regsDisallowedToWrite);
-        if (instrs[i].Info.SpecialKind == ARMInstrInfo::special_WriteMem)
-            return false;
-        if (!thumb && instrs[i].Info.Kind >= ARMInstrInfo::ak_MSR_IMM && instrs[i].Info.Kind <= ARMInstrInfo::ak_MRC)
-            return false;
-        if (i < instrsCount - 1 && instrs[i].Info.Branches())
-            return false;
 
-        u16 srcRegs = instrs[i].Info.SrcRegs & ~(1 << 15);
-        u16 dstRegs = instrs[i].Info.DstRegs & ~(1 << 15);
+    ARMInstrInfo::Info info[instrsCount];
+    for (int i = 0; i < instrsCount; i++)
+        info[i] = instrs[i].Info;
 
-        regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
-        
-        if (dstRegs & regsDisallowedToWrite)
-            return false;
-        regsWrittenTo |= dstRegs;
-    }
-    return true;
+    return ARMInstrInfo::IsIdleLoop(thumb, info, instrsCount);
 }
 
 typedef void (*InterpreterFunc)(ARM* cpu);
@@ -534,18 +780,283 @@ InterpreterFunc InterpretTHUMB[ARMInstrInfo::tk_Count] =
 };
 #undef F
 
+const u32 kMaxLinkCells = 0x20000;
+// block links per block are stored in a TinyVector
+const u32 kMaxBlockLinks = 0x1000;
+
+// cells are allocated from one pool per code segment, so they
+// can be reused once the code which jumps through them is gone
+const u32 kLinkPoolSize = kMaxLinkCells / kCodeSegments;
+
+LinkCell LinkCells[kMaxLinkCells];
+u32 LinkPoolUsed[kCodeSegments];
+u32 CurLinkPool = 0;
+
+void* LinkStub = NULL;
+LinkCell* PendingLink = NULL;
+ReturnStack ReturnStacks[2];
+
+LinkCell* AllocLinkCell(u32 num, u32 addr)
+{
+    // block linking is part of the branch optimisations
+    if (!LinkStub || !Config::JIT_BranchOptimisations || LinkPoolUsed[CurLinkPool] >= kLinkPoolSize)
+        return NULL;
+
+    LinkCell* cell = &LinkCells[CurLinkPool * kLinkPoolSize + LinkPoolUsed[CurLinkPool]++];
+    cell->Target = LinkStub;
+    cell->Addr = addr | num;
+    return cell;
+}
+
+void LinkPending(u32 num, u32 addr, JitBlockEntry entry)
+{
+    LinkCell* cell = PendingLink;
+    PendingLink = NULL;
+
+    if (cell->Addr != (addr | num) || cell->Target != LinkStub)
+        return;
+
+    // VRAM can be remapped without the code inside being invalidated,
+    // the dispatcher catches this, but a link wouldn't
+    u32 region = LocaliseCodeAddress(num, addr) >> 27;
+    if (region == ARMJIT_Memory::memregion_VRAM || region == ARMJIT_Memory::memregion_VWRAM)
+        return;
+
+    JitBlock* block = num == 0 ? JitBlocks9.Find(addr) : JitBlocks7.Find(addr);
+    if (!block || block->EntryPoint != entry || block->Links.Length >= kMaxBlockLinks)
+        return;
+
+    cell->Target = (void*)entry;
+    block->Links.Add(cell);
+}
+
+void UnlinkBlock(JitBlock* block)
+{
+    for (int i = 0; i < block->Links.Length; i++)
+        block->Links[i]->Target = LinkStub;
+    block->Links.Clear();
+}
+
+void UnlinkAllBlocks()
+{
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (u32 i = 0; i < map.Capacity; i++)
+        {
+            if (map.Entries[i])
+                UnlinkBlock(map.Entries[i]);
+        }
+    }
+    PendingLink = NULL;
+}
+
 void RetireJitBlock(JitBlock* block)
 {
-    auto it = RestoreCandidates.find(block->InstrHash);
-    if (it != RestoreCandidates.end())
+    JitBlock* prev = RestoreCandidates.Insert(block);
+    if (prev)
+        FreeJitBlock(prev);
+}
+
+/*
+    Tiered compilation
+        - new blocks are compiled quickly with a small size budget and count down their
+        executions (TierUpCounter), once it runs out the block asks to be recompiled
+        - the hot recompile gets a larger budget, so the register allocation, flag
+        liveness and literal loading span what were several blocks before
+        - additionally the flag liveness of a hot block continues past its end, if it
+        is left through a single static exit the instructions following it are decoded
+        ahead. Flags which are overwritten there before being read are dead at the end
+        of the block and don't need to be computed. The looked ahead instructions are
+        included in the block's address ranges and hash, so that modifying them
+        invalidates the block too
+*/
+const int kBaselineBlockSize = 8;
+const int kMaxHotBlockSize = 64;
+const u32 kTierUpThreshold = 0x800;
+const int kFlagLookahead = 8;
+
+JitBlock* PendingTierUp = NULL;
+u32 HotBlockAddr = UINT32_MAX;
+
+void RemoveBlock(JitBlock* block, bool retire)
+{
+    for (int j = 0; j < block->NumAddresses; j++)
     {
-        delete it->second;
-        it->second = block;
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* range = &CodeMemRegions[addr >> 27][(addr & 0x7FFFFFF) / 512];
+        range->Blocks.RemoveByValue(block);
     }
+
+    FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
+    UnlinkBlock(block);
+    if (block->Num == 0)
+        JitBlocks9.Remove(block->StartAddr);
     else
+        JitBlocks7.Remove(block->StartAddr);
+
+    if (retire)
+        RetireJitBlock(block);
+    else
+        FreeJitBlock(block);
+}
+
+bool GetStaticExit(bool thumb, const FetchedInstr& instr, u32& target)
+{
+    if (!instr.Info.Branches())
     {
-        RestoreCandidates[block->InstrHash] = block;
+        // the block was cut short, it's continued by the next instruction
+        if (instr.Info.EndBlock)
+            return false;
+        target = instr.Addr + (thumb ? 2 : 4);
+        return true;
     }
+
+    // a followed branch at the end means the block was stopped (halt or IRQ)
+    if (!instr.Info.EndBlock)
+        return false;
+    // thumb BLX switches to ARM
+    if (thumb && instr.Info.Kind == ARMInstrInfo::tk_BL_LONG && !(instr.Instr & (1 << 28)))
+        return false;
+
+    u32 cond, linkAddr;
+    bool link;
+    return DecodeBranch(thumb, instr, cond, false, 0, link, linkAddr, target) && cond == 0xE;
+}
+
+int LookaheadFlags(ARM* cpu, bool thumb, u32 addr, u32* instrs, u8& liveFlags)
+{
+    u8 read = 0, written = 0;
+    int count = 0;
+    while (count < kFlagLookahead && LocaliseCodeAddress(cpu->Num, addr))
+    {
+        u32 instr;
+        if (!cpu->PeekCode(addr, thumb, &instr))
+            break;
+        instrs[count++] = instr;
+
+        ARMInstrInfo::Info info = ARMInstrInfo::Decode(thumb, cpu->Num, instr);
+        if (info.Branches() || info.EndBlock
+            || !JITCompiler->CanCompile(thumb, info.Kind)
+            || (!thumb && info.Kind >= ARMInstrInfo::ak_MSR_IMM && info.Kind <= ARMInstrInfo::ak_MRC))
+            break;
+
+        read |= info.ReadFlags & ~written;
+        written |= info.WriteFlags & 0xF;
+        if (written == 0xF)
+        {
+            liveFlags = read;
+            return count;
+        }
+
+        addr += thumb ? 2 : 4;
+    }
+
+    liveFlags = read | (~written & 0xF);
+    return count;
+}
+
+void TierUp()
+{
+    JitBlock* block = PendingTierUp;
+    PendingTierUp = NULL;
+
+    auto& map = block->Num == 0 ? JitBlocks9 : JitBlocks7;
+    if (map.Find(block->StartAddr) != block)
+        return;
+
+    // the lookup for this address is going to miss now,
+    // the block is then recompiled with the larger budget
+    HotBlockAddr = block->StartAddr | block->Num;
+    RemoveBlock(block, true);
+}
+
+/*
+    Code segments
+        - the backend splits its code buffer into kCodeSegments segments which are
+        filled one after another, once it runs out of space it wraps around and
+        reuses the oldest segment
+        - only the blocks inside of that segment are thrown away, instead of
+        flushing the whole cache
+*/
+u32 StatSegmentsEvicted = 0;
+u32 StatBlocksEvicted = 0;
+u32 StatBlocksCompiled = 0;
+
+bool IsLinkCellInPool(LinkCell* cell, int pool)
+{
+    return cell >= &LinkCells[pool * kLinkPoolSize] && cell < &LinkCells[(pool + 1) * kLinkPoolSize];
+}
+
+void EvictCodeSegment(int segment, u8* start, u8* end, u32 unusedBytes)
+{
+    std::vector<JitBlock*> evicted;
+
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (u32 i = 0; i < map.Capacity; i++)
+        {
+            JitBlock* block = map.Entries[i];
+            if (!block)
+                continue;
+
+            if ((u8*)block->EntryPoint >= start && (u8*)block->EntryPoint < end)
+            {
+                evicted.push_back(block);
+            }
+            else
+            {
+                // the cells of the segment are going to be reused
+                for (int j = 0; j < block->Links.Length;)
+                {
+                    if (IsLinkCellInPool(block->Links[j], segment))
+                        block->Links.Remove(j);
+                    else
+                        j++;
+                }
+            }
+        }
+    }
+    for (JitBlock* block : evicted)
+    {
+        if (PendingTierUp == block)
+            PendingTierUp = NULL;
+        RemoveBlock(block, false);
+    }
+
+    std::vector<u32> retired;
+    for (u32 i = 0; i < RestoreCandidates.Capacity; i++)
+    {
+        JitBlock* block = RestoreCandidates.Entries[i];
+        if (block && (u8*)block->EntryPoint >= start && (u8*)block->EntryPoint < end)
+            retired.push_back(block->InstrHash);
+    }
+    for (u32 hash : retired)
+        FreeJitBlock(RestoreCandidates.Remove(hash));
+
+    if (PendingLink && IsLinkCellInPool(PendingLink, segment))
+        PendingLink = NULL;
+    for (int num = 0; num < 2; num++)
+    {
+        for (u32 i = 0; i < ReturnStackSize; i++)
+        {
+            ReturnStackEntry& entry = ReturnStacks[num].Entries[i];
+            if (entry.Cell && IsLinkCellInPool(entry.Cell, segment))
+            {
+                entry.Cell = NULL;
+                entry.R15 = 0;
+            }
+        }
+    }
+    LinkPoolUsed[segment] = 0;
+    CurLinkPool = segment;
+
+    StatSegmentsEvicted++;
+    StatBlocksEvicted += evicted.size() + retired.size();
+    JIT_DEBUGPRINT("JIT: evicted code segment %d, %d blocks (%d bytes left unused), %d segments/%d blocks evicted and %d blocks compiled so far\n",
+        segment, (int)(evicted.size() + retired.size()), unusedBytes,
+        StatSegmentsEvicted, StatBlocksEvicted, StatBlocksCompiled);
 }
 
 void CompileBlock(ARM* cpu)
@@ -559,6 +1070,22 @@ void CompileBlock(ARM* cpu)
 
     u32 blockAddr = cpu->R[15] - (thumb ? 2 : 4);
 
+    int maxBlockSize = Config::JIT_MaxBlockSize;
+    bool baseline = false;
+    if (Config::JIT_TieredCompilation)
+    {
+        if (HotBlockAddr == (blockAddr | cpu->Num))
+        {
+            maxBlockSize = std::min(Config::JIT_MaxBlockSize * 2, kMaxHotBlockSize);
+        }
+        else
+        {
+            maxBlockSize = std::min(Config::JIT_MaxBlockSize, kBaselineBlockSize);
+            baseline = true;
+        }
+    }
+    HotBlockAddr = UINT32_MAX;
+
     u32 localAddr = LocaliseCodeAddress(cpu->Num, blockAddr);
     if (!localAddr)
     {
@@ -566,42 +1093,43 @@ void CompileBlock(ARM* cpu)
     }
 
     auto& map = cpu->Num == 0 ? JitBlocks9 : JitBlocks7;
-    auto existingBlockIt = map.find(blockAddr);
-    if (existingBlockIt != map.end())
+    JitBlock* existingBlock = map.Find(blockAddr);
+    if (existingBlock)
     {
         // there's already a block, though it's not inside the fast map
         // could be that there are two blocks at the same physical addr
         // but different mirrors
-        u32 otherLocalAddr = existingBlockIt->second->StartAddrLocal;
+        u32 otherLocalAddr = existingBlock->StartAddrLocal;
 
         if (localAddr == otherLocalAddr)
         {
-            JIT_DEBUGPRINT("switching out block %x %x %x\n", localAddr, blockAddr, existingBlockIt->second->StartAddr);
+            JIT_DEBUGPRINT("switching out block %x %x %x\n", localAddr, blockAddr, existingBlock->StartAddr);
 
             u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
             *entry = ((u64)blockAddr | cpu->Num) << 32;
-            *entry |= JITCompiler->SubEntryOffset(existingBlockIt->second->EntryPoint);
+            *entry |= JITCompiler->SubEntryOffset(existingBlock->EntryPoint);
             return;
         }
 
         // some memory has been remapped
-        RetireJitBlock(existingBlockIt->second);        
-        map.erase(existingBlockIt);
+        map.Remove(blockAddr);
+        UnlinkBlock(existingBlock);
+        RetireJitBlock(existingBlock);
     }
 
-    FetchedInstr instrs[Config::JIT_MaxBlockSize];
+    FetchedInstr instrs[maxBlockSize];
     int i = 0;
     u32 r15 = cpu->R[15];
 
-    u32 addressRanges[Config::JIT_MaxBlockSize];
-    u32 addressMasks[Config::JIT_MaxBlockSize] = {0};
+    u32 addressRanges[maxBlockSize + kFlagLookahead];
+    u32 addressMasks[maxBlockSize + kFlagLookahead] = {0};
     u32 numAddressRanges = 0;
 
     u32 numLiterals = 0;
-    u32 literalLoadAddrs[Config::JIT_MaxBlockSize];
+    u32 literalLoadAddrs[maxBlockSize];
     // they are going to be hashed
-    u32 literalValues[Config::JIT_MaxBlockSize];
-    u32 instrValues[Config::JIT_MaxBlockSize];
+    u32 literalValues[maxBlockSize];
+    u32 instrValues[maxBlockSize + kFlagLookahead];
 
     cpu->FillPipeline();
     u32 nextInstr[2] = {cpu->NextInstr[0], cpu->NextInstr[1]};
@@ -715,7 +1243,8 @@ void CompileBlock(ARM* cpu)
         u32 literalAddr;
         if (Config::JIT_LiteralOptimisations
             && instrs[i].Info.SpecialKind == ARMInstrInfo::special_LoadLiteral
-            && DecodeLiteral(thumb, instrs[i], literalAddr))
+            && DecodeLiteral(thumb, instrs[i], literalAddr)
+            && !IsVolatileLiteral(LocaliseCodeAddress(cpu->Num, literalAddr)))
         {
             u32 translatedAddr = LocaliseCodeAddress(cpu->Num, literalAddr);
             if (!translatedAddr)
@@ -783,7 +1312,7 @@ void CompileBlock(ARM* cpu)
                         JIT_DEBUGPRINT("found %s idle loop %d in block %08x\n", thumb ? "thumb" : "arm", cpu->Num, blockAddr);
                     }
                 }
-                else if (hasBranched && !isBackJump && i + 1 < Config::JIT_MaxBlockSize)
+                else if (hasBranched && !isBackJump && i + 1 < maxBlockSize)
                 {
                     if (link)
                     {
@@ -811,7 +1340,7 @@ void CompileBlock(ARM* cpu)
                 }
             }
 
-            if (!hasBranched && cond < 0xE && i + 1 < Config::JIT_MaxBlockSize)
+            if (!hasBranched && cond < 0xE && i + 1 < maxBlockSize)
             {
                 instrs[i].Info.EndBlock = false;
                 instrs[i].BranchFlags |= branch_FollowCondNotTaken;
@@ -824,19 +1353,38 @@ void CompileBlock(ARM* cpu)
         bool secondaryFlagReadCond = !canCompile || (instrs[i - 1].BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
         if (instrs[i - 1].Info.ReadFlags != 0 || secondaryFlagReadCond)
             FloodFillSetFlags(instrs, i - 2, !secondaryFlagReadCond ? instrs[i - 1].Info.ReadFlags : 0xF);
-    } while(!instrs[i - 1].Info.EndBlock && i < Config::JIT_MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+    } while(!instrs[i - 1].Info.EndBlock && i < maxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+
+    u8 exitFlags = 0xF;
+    int numLookahead = 0;
+    u32 lookaheadAddr;
+    if (Config::JIT_TieredCompilation && !baseline
+        && GetStaticExit(thumb, instrs[i - 1], lookaheadAddr))
+    {
+        numLookahead = LookaheadFlags(cpu, thumb, lookaheadAddr, &instrValues[i], exitFlags);
+        for (int k = 0; k < numLookahead; k++)
+        {
+            u32 translatedAddr = LocaliseCodeAddress(cpu->Num, lookaheadAddr + k * (thumb ? 2 : 4));
+            u32 translatedAddrRounded = translatedAddr & ~0x1FF;
+
+            u32 j = 0;
+            for (; j < numAddressRanges; j++)
+                if (addressRanges[j] == translatedAddrRounded)
+                    break;
+            if (j == numAddressRanges)
+                addressRanges[numAddressRanges++] = translatedAddrRounded;
+            addressMasks[j] |= 1 << ((translatedAddr & 0x1FF) / 16);
+        }
+        JIT_DEBUGPRINT("flags live at exit %x (%d instrs looked ahead)\n", exitFlags, numLookahead);
+    }
 
     u32 literalHash = (u32)XXH3_64bits(literalValues, numLiterals * 4);
-    u32 instrHash = (u32)XXH3_64bits(instrValues, i * 4);
+    u32 instrHash = (u32)XXH3_64bits(instrValues, (i + numLookahead) * 4);
 
-    auto prevBlockIt = RestoreCandidates.find(instrHash);
-    JitBlock* prevBlock = NULL;
+    JitBlock* prevBlock = RestoreCandidates.Remove(instrHash);
     bool mayRestore = true;
-    if (prevBlockIt != RestoreCandidates.end())
+    if (prevBlock)
     {
-        prevBlock = prevBlockIt->second;
-        RestoreCandidates.erase(prevBlockIt);
-
         mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash;
 
         if (mayRestore && prevBlock->NumAddresses == numAddressRanges)
@@ -863,9 +1411,9 @@ void CompileBlock(ARM* cpu)
     if (!mayRestore)
     {
         if (prevBlock)
-            delete prevBlock;
+            FreeJitBlock(prevBlock);
 
-        block = new JitBlock(cpu->Num, i, numAddressRanges, numLiterals);
+        block = AllocJitBlock(cpu->Num, numAddressRanges, numLiterals);
         block->LiteralHash = literalHash;
         block->InstrHash = instrHash;
         for (int j = 0; j < numAddressRanges; j++)
@@ -878,9 +1426,12 @@ void CompileBlock(ARM* cpu)
         block->StartAddr = blockAddr;
         block->StartAddrLocal = localAddr;
 
-        FloodFillSetFlags(instrs, i - 1, 0xF);
+        FloodFillSetFlags(instrs, i - 1, exitFlags);
+
+        StatBlocksCompiled++;
 
-        block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i);
+        block->TierUpCounter = kTierUpThreshold;
+        block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i, baseline ? block : NULL);
 
         JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
     }
@@ -907,10 +1458,7 @@ void CompileBlock(ARM* cpu)
         range->Blocks.Add(block);
     }
 
-    if (cpu->Num == 0)
-        JitBlocks9[blockAddr] = block;
-    else
-        JitBlocks7[blockAddr] = block;
+    map.Insert(block);
 
     u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
     *entry = ((u64)blockAddr | cpu->Num) << 32;
@@ -968,6 +1516,13 @@ void InvalidateByAddr(u32 localAddr)
                     InvalidLiterals.Add(localAddr);
                     JIT_DEBUGPRINT("found invalid literal %d\n", InvalidLiterals.Length);
                 }
+                if (Config::JIT_PersistentCache
+                    && VolatileLiterals.Length < kLiteralCacheMax
+                    && VolatileLiterals.Find(localAddr) == -1)
+                {
+                    VolatileLiterals.Add(localAddr);
+                    VolatileLiteralsDirty = true;
+                }
                 literalInvalidation = true;
                 break;
             }
@@ -995,18 +1550,20 @@ void InvalidateByAddr(u32 localAddr)
         }
 
         FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
+        UnlinkBlock(block);
         if (block->Num == 0)
-            JitBlocks9.erase(block->StartAddr);
+            JitBlocks9.Remove(block->StartAddr);
         else
-            JitBlocks7.erase(block->StartAddr);
+            JitBlocks7.Remove(block->StartAddr);
 
-        if (!literalInvalidation)
+        // decoded blocks are cheaper to redo than to keep around
+        if (!literalInvalidation && !block->Decoded.Length)
         {
             RetireJitBlock(block);
         }
         else
         {
-            delete block;
+            FreeJitBlock(block);
         }
     }
 }
@@ -1030,11 +1587,41 @@ void CheckAndInvalidate(u32 addr)
         InvalidateByAddr(localAddr);
 }
 
+// addr and len must not cross the mirroring boundary of the region
+void CheckAndInvalidateRange(u32 num, int region, u32 addr, u32 len)
+{
+    u32 localAddr = ARMJIT_Memory::LocaliseAddress(region, num, addr);
+    u32 end = localAddr + len;
+
+    for (u32 i = localAddr & ~0xF; i < end;)
+    {
+        AddressRange* range = &CodeMemRegions[region][(i & 0x7FFFFFF) / 512];
+        if (!range->Code)
+        {
+            i = (i & ~0x1FF) + 512;
+            continue;
+        }
+
+        if (range->Code & (1 << ((i & 0x1FF) / 16)))
+            InvalidateByAddr(i);
+        i += 16;
+    }
+}
+
 JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr)
 {
+    if (PendingTierUp)
+        TierUp();
+
     u64* entry = &entries[offset / 2];
     if (*entry >> 32 == (addr | num))
-        return JITCompiler->AddEntryOffset((u32)*entry);
+    {
+        JitBlockEntry block = JITCompiler->AddEntryOffset((u32)*entry);
+        if (PendingLink)
+            LinkPending(num, addr, block);
+        return block;
+    }
+    PendingLink = NULL;
     return NULL;
 }
 
@@ -1062,6 +1649,204 @@ bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32&
     return false;
 }
 
+/*
+    Decode cache
+        - without the JIT the interpreter runs code from blocks of instructions which
+        have been fetched and looked up ahead of time, instead of fetching and
+        decoding every instruction every time it's executed
+        - each instruction holds its handler from the interpreter's tables, the raw
+        instruction word for the operands and its condition. A block also holds the
+        two words following its last instruction, so that the pipeline can be kept
+        exactly like the interpreter would have it
+        - blocks end where ARMInstrInfo::Decode says a JIT block ends, or at
+        kMaxDecodedBlockSize instructions
+        - they're JitBlocks without an EntryPoint, so they're found and invalidated
+        through the same tables and CheckAndInvalidate hooks as compiled code.
+        The fast lookup entries hold the block's Index instead of a code offset
+        - a block is only entered if its first two words are what's in the pipeline,
+        code modified after it was fetched is run by the plain interpreter
+        - JIT and decoded blocks can't be mixed and the parallel ARM7 writes memory
+        without invalidating anything, so switching modes throws everything away
+*/
+const int kMaxDecodedBlockSize = 32;
+
+enum
+{
+    execMode_Interpreter,
+    execMode_DecodeCache,
+    execMode_JIT,
+};
+int ExecMode = execMode_Interpreter;
+bool DecodeCacheActive = false;
+
+void SetExecutionMode(bool jit, bool decodeCache)
+{
+    int mode = jit ? execMode_JIT : (decodeCache ? execMode_DecodeCache : execMode_Interpreter);
+    if (mode != ExecMode)
+    {
+        ExecMode = mode;
+        if (JitBlocks9.Count || JitBlocks7.Count || RestoreCandidates.Count)
+            ResetBlockCache();
+    }
+    DecodeCacheActive = mode == execMode_DecodeCache;
+}
+
+JitBlock* DecodeBlock(ARM* cpu, bool thumb, u32 blockAddr)
+{
+    u32 localAddr = LocaliseCodeAddress(cpu->Num, blockAddr);
+    if (!localAddr)
+        return NULL;
+
+    auto& map = cpu->Num == 0 ? JitBlocks9 : JitBlocks7;
+    JitBlock* existingBlock = map.Find(blockAddr);
+    if (existingBlock)
+    {
+        // same as in CompileBlock, the block might have been
+        // entered through another mirror since
+        if (existingBlock->StartAddrLocal == localAddr && existingBlock->Thumb == thumb)
+        {
+            u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
+            *entry = ((u64)blockAddr | cpu->Num) << 32 | existingBlock->Index;
+            return existingBlock;
+        }
+
+        // some memory has been remapped, or the code is run in the other mode
+        RemoveBlock(existingBlock, false);
+    }
+
+    u32 wordSize = thumb ? 2 : 4;
+    u32 words[kMaxDecodedBlockSize + 2];
+    int numWords = 0;
+    int numInstrs = 0;
+    while (numInstrs < kMaxDecodedBlockSize)
+    {
+        // an instruction is executed once the two words after it are fetched
+        while (numWords < numInstrs + 3)
+        {
+            u32 addr = blockAddr + numWords * wordSize;
+            // ARM9 THUMB code is fetched by words, the upper half is the next instruction
+            bool halfword = thumb && (cpu->Num == 1 || (addr & 0x2));
+            if (!LocaliseCodeAddress(cpu->Num, addr) || !cpu->PeekCode(addr, halfword, &words[numWords]))
+                break;
+            numWords++;
+        }
+        if (numWords < numInstrs + 3)
+            break;
+
+        ARMInstrInfo::Info info = ARMInstrInfo::Decode(thumb, cpu->Num, words[numInstrs]);
+        numInstrs++;
+        if (info.EndBlock)
+            break;
+    }
+    if (numInstrs == 0)
+        return NULL;
+    numWords = numInstrs + 2;
+
+    u32 addressRanges[kMaxDecodedBlockSize + 2];
+    u32 addressMasks[kMaxDecodedBlockSize + 2] = {0};
+    u32 numAddressRanges = 0;
+    for (int i = 0; i < numWords; i++)
+    {
+        u32 translatedAddr = LocaliseCodeAddress(cpu->Num, blockAddr + i * wordSize);
+        u32 translatedAddrRounded = translatedAddr & ~0x1FF;
+        u32 j = 0;
+        while (j < numAddressRanges && addressRanges[j] != translatedAddrRounded)
+            j++;
+        if (j == numAddressRanges)
+            addressRanges[numAddressRanges++] = translatedAddrRounded;
+        addressMasks[j] |= 1 << ((translatedAddr & 0x1FF) / 16);
+    }
+
+    JitBlock* block = AllocJitBlock(cpu->Num, numAddressRanges, 0);
+    block->StartAddr = blockAddr;
+    block->StartAddrLocal = localAddr;
+    block->InstrHash = 0;
+    block->LiteralHash = 0;
+    block->EntryPoint = NULL;
+    block->TierUpCounter = 0;
+    block->Thumb = thumb;
+    for (u32 j = 0; j < numAddressRanges; j++)
+    {
+        block->AddressRanges()[j] = addressRanges[j];
+        block->AddressMasks()[j] = addressMasks[j];
+    }
+
+    block->Decoded.SetLength(numWords);
+    for (int i = 0; i < numWords; i++)
+    {
+        DecodedInstr& instr = block->Decoded.Data[i];
+        u32 word = words[i];
+        instr.Instr = word;
+        instr.Cond = 0xE;
+        // the words after the block are only there for the pipeline
+        instr.Handler = NULL;
+        if (i < numInstrs)
+        {
+            if (thumb)
+            {
+                instr.Handler = ARMInterpreter::THUMBInstrTable[(word >> 6) & 0x3FF];
+            }
+            else if (cpu->Num == 0 && (word & 0xFE000000) == 0xFA000000)
+            {
+                instr.Handler = ARMInterpreter::A_BLX_IMM;
+            }
+            else
+            {
+                instr.Handler = ARMInterpreter::ARMInstrTable[((word >> 4) & 0xF) | ((word >> 16) & 0xFF0)];
+                instr.Cond = word >> 28;
+            }
+        }
+
+        u32 fetchAddr = blockAddr + (i + 2) * wordSize;
+        instr.CodeFetch = !(thumb && (fetchAddr & 0x2));
+    }
+
+    for (u32 j = 0; j < numAddressRanges; j++)
+    {
+        AddressRange* region = CodeMemRegions[addressRanges[j] >> 27];
+
+        if (!PageContainsCode(&region[(addressRanges[j] & 0x7FFF000) / 512]))
+            ARMJIT_Memory::SetCodeProtection(addressRanges[j] >> 27, addressRanges[j] & 0x7FFFFFF, true);
+
+        AddressRange* range = &region[(addressRanges[j] & 0x7FFFFFF) / 512];
+        range->Code |= addressMasks[j];
+        range->Blocks.Add(block);
+    }
+
+    map.Insert(block);
+
+    u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
+    *entry = ((u64)blockAddr | cpu->Num) << 32 | block->Index;
+
+    return block;
+}
+
+DecodedInstr* LookUpDecodedBlock(ARM* cpu)
+{
+    bool thumb = cpu->CPSR & 0x20;
+    u32 addr = cpu->R[15] - (thumb ? 2 : 4);
+
+    if ((addr < cpu->FastBlockLookupStart || addr >= (cpu->FastBlockLookupStart + cpu->FastBlockLookupSize))
+        && !SetupExecutableRegion(cpu->Num, addr, cpu->FastBlockLookup, cpu->FastBlockLookupStart, cpu->FastBlockLookupSize))
+        return NULL;
+
+    u64 entry = cpu->FastBlockLookup[(addr - cpu->FastBlockLookupStart) / 2];
+    JitBlock* block;
+    if (entry >> 32 == (addr | cpu->Num)
+        && BlockSlabs[(u32)entry / BlockSlabSize][(u32)entry % BlockSlabSize].Thumb == thumb)
+        block = &BlockSlabs[(u32)entry / BlockSlabSize][(u32)entry % BlockSlabSize];
+    else
+        block = DecodeBlock(cpu, thumb, addr);
+
+    // the pipeline doesn't hold what's in memory anymore
+    if (!block
+        || block->Decoded.Data[0].Instr != cpu->NextInstr[0]
+        || block->Decoded.Data[1].Instr != cpu->NextInstr[1])
+        return NULL;
+
+    return block->Decoded.Data;
+}
+
 template void CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(u32);
 template void CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(u32);
 template void CheckAndInvalidate<0, ARMJIT_Memory::memregion_SharedWRAM>(u32);
@@ -1077,10 +1862,100 @@ template void CheckAndInvalidate<1, ARMJIT_Memory::memregion_NewSharedWRAM_B>(u3
 template void CheckAndInvalidate<0, ARMJIT_Memory::memregion_NewSharedWRAM_C>(u32);
 template void CheckAndInvalidate<1, ARMJIT_Memory::memregion_NewSharedWRAM_C>(u32);
 
+// code memory as it was before loading a savestate,
+// in 512 byte ranges which contain code
+std::vector<u32> StateLoadRanges;
+std::vector<u8> StateLoadData;
+
+u8* GetCodeMemory(int region)
+{
+    switch (region)
+    {
+    case ARMJIT_Memory::memregion_ITCM: return NDS::ARM9->ITCM;
+    case ARMJIT_Memory::memregion_MainRAM: return NDS::MainRAM;
+    case ARMJIT_Memory::memregion_SharedWRAM: return NDS::SharedWRAM;
+    case ARMJIT_Memory::memregion_WRAM7: return NDS::ARM7WRAM;
+    case ARMJIT_Memory::memregion_NewSharedWRAM_A: return DSi::NWRAM_A;
+    case ARMJIT_Memory::memregion_NewSharedWRAM_B: return DSi::NWRAM_B;
+    case ARMJIT_Memory::memregion_NewSharedWRAM_C: return DSi::NWRAM_C;
+    default: return NULL;
+    }
+}
+
+void PrepareStateLoad()
+{
+    StateLoadRanges.clear();
+    StateLoadData.clear();
+
+    for (int region = 0; region < ARMJIT_Memory::memregions_Count; region++)
+    {
+        u8* mem = GetCodeMemory(region);
+        if (!mem)
+            continue;
+
+        for (u32 i = 0; i < CodeRegionSizes[region] / 512; i++)
+        {
+            if (!CodeMemRegions[region][i].Code)
+                continue;
+
+            StateLoadRanges.push_back((region << 27) | (i * 512));
+            StateLoadData.insert(StateLoadData.end(), &mem[i * 512], &mem[(i + 1) * 512]);
+        }
+    }
+}
+
+void FinishStateLoad()
+{
+    // the memory mappings may have changed
+    ARMJIT_Memory::Reset();
+
+    // only throw away the blocks whose code or literals differ from what was loaded
+    u32 numInvalidated = 0;
+    for (u32 i = 0; i < StateLoadRanges.size(); i++)
+    {
+        u32 localAddr = StateLoadRanges[i];
+        u8* oldData = &StateLoadData[i * 512];
+        u8* newData = GetCodeMemory(localAddr >> 27) + (localAddr & 0x7FFFFFF);
+        AddressRange* range = &CodeMemRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 512];
+
+        for (u32 j = 0; j < 512; j += 16)
+        {
+            if ((range->Code & (1 << (j / 16))) && memcmp(&oldData[j], &newData[j], 16) != 0)
+            {
+                InvalidateByAddr(localAddr + j);
+                numInvalidated++;
+            }
+        }
+    }
+
+    // VRAM contents are looked at through the mapping, which may have changed too.
+    // the BIOS regions are never touched by savestates
+    const int vramRegions[] = {ARMJIT_Memory::memregion_VRAM, ARMJIT_Memory::memregion_VWRAM};
+    for (int region : vramRegions)
+    {
+        for (u32 i = 0; i < CodeRegionSizes[region]; i += 16)
+        {
+            if (CodeMemRegions[region][i / 512].Code & (1 << ((i & 0x1FF) / 16)))
+            {
+                InvalidateByAddr((region << 27) | i);
+                numInvalidated++;
+            }
+        }
+    }
+
+    JIT_DEBUGPRINT("savestate load: invalidated %d code units\n", numInvalidated);
+
+    StateLoadRanges.clear();
+    StateLoadData.clear();
+}
+
 void ResetBlockCache()
 {
     printf("Resetting JIT block cache...\n");
 
+    StateLoadRanges.clear();
+    StateLoadData.clear();
+
     // could be replace through a function which only resets
     // the permissions but we're too lazy
     ARMJIT_Memory::Reset();
@@ -1091,34 +1966,39 @@ void ResetBlockCache()
         if (FastBlockLookupRegions[i])
             memset(FastBlockLookupRegions[i], 0xFF, CodeRegionSizes[i] * sizeof(u64) / 2);
     }
-    for (auto it = RestoreCandidates.begin(); it != RestoreCandidates.end(); it++)
-        delete it->second;
-    RestoreCandidates.clear();
-    for (auto it : JitBlocks9)
+    for (u32 i = 0; i < RestoreCandidates.Capacity; i++)
     {
-        JitBlock* block = it.second;
-        for (int j = 0; j < block->NumAddresses; j++)
-        {
-            u32 addr = block->AddressRanges()[j];
-            AddressRange* range = &CodeMemRegions[addr >> 27][(addr & 0x7FFFFFF) / 512];
-            range->Blocks.Clear();
-            range->Code = 0;
-        }
-        delete block;
+        if (RestoreCandidates.Entries[i])
+            FreeJitBlock(RestoreCandidates.Entries[i]);
     }
-    for (auto it : JitBlocks7)
+    RestoreCandidates.Clear();
+    for (int num = 0; num < 2; num++)
     {
-        JitBlock* block = it.second;
-        for (int j = 0; j < block->NumAddresses; j++)
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (u32 i = 0; i < map.Capacity; i++)
         {
-            u32 addr = block->AddressRanges()[j];
-            AddressRange* range = &CodeMemRegions[addr >> 27][(addr & 0x7FFFFFF) / 512];
-            range->Blocks.Clear();
-            range->Code = 0;
+            JitBlock* block = map.Entries[i];
+            if (!block)
+                continue;
+
+            for (int j = 0; j < block->NumAddresses; j++)
+            {
+                u32 addr = block->AddressRanges()[j];
+                AddressRange* range = &CodeMemRegions[addr >> 27][(addr & 0x7FFFFFF) / 512];
+                range->Blocks.Clear();
+                range->Code = 0;
+            }
+            FreeJitBlock(block);
         }
+        map.Clear();
     }
-    JitBlocks9.clear();
-    JitBlocks7.clear();
+
+    memset(LinkPoolUsed, 0, sizeof(LinkPoolUsed));
+    CurLinkPool = 0;
+    PendingLink = NULL;
+    PendingTierUp = NULL;
+    HotBlockAddr = UINT32_MAX;
+    memset(ReturnStacks, 0, sizeof(ReturnStacks));
 
     JITCompiler->Reset();
 }
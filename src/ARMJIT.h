@@ -11,6 +11,18 @@ namespace ARMJIT
 
 typedef void (*JitBlockEntry)();
 
+// an instruction of a block of the decode cache, see ARMJIT.cpp
+struct DecodedInstr
+{
+    void (*Handler)(ARM* cpu);
+    u32 Instr;
+    u8 Cond;
+    // ARM9 only, whether executing it fetches a new word
+    bool CodeFetch;
+};
+
+extern bool DecodeCacheActive;
+
 void Init();
 void DeInit();
 
@@ -22,14 +34,26 @@ void InvalidateByAddr(u32 pseudoPhysical);
 
 template <u32 num, int region>
 void CheckAndInvalidate(u32 addr);
+void CheckAndInvalidateRange(u32 num, int region, u32 addr, u32 len);
 
 void CompileBlock(ARM* cpu);
 
 void ResetBlockCache();
 
+void UnlinkAllBlocks();
+
+void LoadLiteralCache(u32 crc);
+void SaveLiteralCache();
+
+void PrepareStateLoad();
+void FinishStateLoad();
+
 JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr);
 bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size);
 
+void SetExecutionMode(bool jit, bool decodeCache);
+DecodedInstr* LookUpDecodedBlock(ARM* cpu);
+
 }
 
 extern "C" void ARM_Dispatch(ARM* cpu, ARMJIT::JitBlockEntry entry);
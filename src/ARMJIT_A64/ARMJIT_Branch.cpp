@@ -139,6 +139,8 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
     {
         MOVI2R(W0, newPC);
         STR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, R[15]));
+        ExitStatic = true;
+        ExitTarget = addr;
     }
     if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
         ConstantCycles += cycles;
@@ -323,16 +325,25 @@ void Compiler::A_Comp_BranchImm()
     }
 
     if (link)
+    {
         MOVI2R(MapReg(14), R15 - 4);
+        Comp_PushReturnStack();
+    }
 
     Comp_JumpTo(target);
 }
 
 void Compiler::A_Comp_BranchXchangeReg()
 {
+    bool link = (CurInstr.Instr & 0xF0) == 0x30; // BLX_reg
+    if (link)
+        Comp_PushReturnStack();
+    else if (CurInstr.A_Reg(0) == 14 && CurInstr.Cond() >= 0xE)
+        ExitReturn = true;
+
     ARM64Reg rn = MapReg(CurInstr.A_Reg(0));
     MOV(W0, rn);
-    if ((CurInstr.Instr & 0xF0) == 0x30) // BLX_reg
+    if (link)
         MOVI2R(MapReg(14), R15 - 4);
     Comp_JumpTo(W0, true);
 }
@@ -373,12 +384,15 @@ void Compiler::T_Comp_BranchXchangeReg()
             printf("BLX unsupported on ARM7!!!\n");
             return;
         }
+        Comp_PushReturnStack();
         MOV(W0, MapReg(CurInstr.A_Reg(3)));
         MOVI2R(MapReg(14), R15 - 1);
         Comp_JumpTo(W0, true);
     }
     else
     {
+        ExitReturn = CurInstr.A_Reg(3) == 14;
+
         ARM64Reg rn = MapReg(CurInstr.A_Reg(3));
         Comp_JumpTo(rn, true);
     }
@@ -393,6 +407,8 @@ void Compiler::T_Comp_BL_LONG_1()
 
 void Compiler::T_Comp_BL_LONG_2()
 {
+    Comp_PushReturnStack();
+
     ARM64Reg lr = MapReg(14);
     s32 offset = (CurInstr.Instr & 0x7FF) << 1;
     ADD(W0, lr, offset);
@@ -414,8 +430,88 @@ void Compiler::T_Comp_BL_Merged()
         target |= 1;
 
     MOVI2R(MapReg(14), (R15 - 2) | 1);
-    
+    Comp_PushReturnStack();
+
     Comp_JumpTo(target);
 }
 
+void Compiler::Comp_PushReturnStack()
+{
+    // the call returns to the instruction after it, in the current mode
+    LinkCell* cell = AllocLinkCell(Num, R15 - (Thumb ? 2 : 4));
+    if (!cell)
+        return;
+
+    // W0 is left alone, it might hold the jump target already
+    MOVP2R(X1, &ReturnStacks[Num]);
+    LDR(INDEX_UNSIGNED, W2, X1, offsetof(ReturnStack, Pos));
+    ADD(W2, W2, 1);
+    ANDI2R(W2, W2, ReturnStackSize - 1);
+    STR(INDEX_UNSIGNED, W2, X1, offsetof(ReturnStack, Pos));
+    ADD(X1, X1, X2, ArithOption(X2, ST_LSL, 4));
+    MOVP2R(X2, cell);
+    STR(INDEX_UNSIGNED, X2, X1, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, Cell));
+    MOVI2R(W2, R15);
+    STR(INDEX_UNSIGNED, W2, X1, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, R15));
+}
+
+void Compiler::Comp_FollowLink()
+{
+    // expects the cell in X3 and falls through if the
+    // block has to return to the dispatcher instead
+
+    // the dispatcher would stop here as well
+    LDR(INDEX_UNSIGNED, W0, RCPU, offsetof(ARM, StopExecution));
+    FixupBranch stop = CBNZ(W0);
+
+    // do what the dispatcher loop does between two blocks
+    MOVP2R(X1, Num == 0 ? &NDS::ARM9Timestamp : &NDS::ARM7Timestamp);
+    LDR(INDEX_UNSIGNED, X0, X1, 0);
+    ADD(X0, X0, EncodeRegTo64(RCycles));
+    STR(INDEX_UNSIGNED, X0, X1, 0);
+    MOVI2R(RCycles, 0);
+    MOVP2R(X1, Num == 0 ? &NDS::ARM9Target : &NDS::ARM7Target);
+    LDR(INDEX_UNSIGNED, X1, X1, 0);
+    CMP(X0, X1);
+    FixupBranch outOfTime = B(CC_HS);
+
+    // the next block expects the CPSR in memory to be up to date
+    STR(INDEX_UNSIGNED, RCPSR, RCPU, offsetof(ARM, CPSR));
+    LDR(INDEX_UNSIGNED, X0, X3, offsetof(LinkCell, Target));
+    BR(X0);
+
+    SetJumpTarget(stop);
+    SetJumpTarget(outOfTime);
+}
+
+void Compiler::Comp_LinkExit(u32 addr)
+{
+    LinkCell* cell = AllocLinkCell(Num, addr);
+    if (!cell)
+        return;
+
+    MOVP2R(X3, cell);
+    Comp_FollowLink();
+}
+
+void Compiler::Comp_ReturnExit()
+{
+    MOVP2R(X1, &ReturnStacks[Num]);
+    LDR(INDEX_UNSIGNED, W0, X1, offsetof(ReturnStack, Pos));
+    SUB(W2, W0, 1);
+    ANDI2R(W2, W2, ReturnStackSize - 1);
+    STR(INDEX_UNSIGNED, W2, X1, offsetof(ReturnStack, Pos));
+    ADD(X1, X1, X0, ArithOption(X0, ST_LSL, 4));
+
+    LDR(INDEX_UNSIGNED, W0, X1, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, R15));
+    LDR(INDEX_UNSIGNED, W2, RCPU, offsetof(ARM, R[15]));
+    CMP(W0, W2);
+    FixupBranch mispredicted = B(CC_NEQ);
+
+    LDR(INDEX_UNSIGNED, X3, X1, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, Cell));
+    Comp_FollowLink();
+
+    SetJumpTarget(mispredicted);
+}
+
 }
\ No newline at end of file
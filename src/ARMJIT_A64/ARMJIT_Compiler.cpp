@@ -404,6 +404,14 @@ Compiler::Compiler()
         }
     }
 
+    {
+        // X3 the cell which wants to be linked
+        LinkStub = GetRXPtr();
+        MOVP2R(X0, &PendingLink);
+        STR(INDEX_UNSIGNED, X3, X0, 0);
+        QuickTailCall(X0, ARM_Ret);
+    }
+
     FlushIcache();
 
     JitMemSecondarySize = 1024*1024*4;
@@ -634,7 +642,7 @@ void Compiler::Comp_BranchSpecialBehaviour(bool taken)
     }
 }
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount)
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, JitBlock* tierUpBlock)
 {
     if (JitMemMainSize - GetCodeOffset() < 1024 * 16)
     {
@@ -649,6 +657,22 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     JitBlockEntry res = (JitBlockEntry)GetRXPtr();
 
+    if (tierUpBlock)
+    {
+        // leave before anything has been executed, so that the block
+        // can be recompiled and run from the start
+        MOVP2R(X0, &tierUpBlock->TierUpCounter);
+        LDR(INDEX_UNSIGNED, W1, X0, 0);
+        SUBS(W1, W1, 1);
+        STR(INDEX_UNSIGNED, W1, X0, 0);
+        FixupBranch notHot = B(CC_NEQ);
+        MOVP2R(X0, &PendingTierUp);
+        MOVP2R(X1, tierUpBlock);
+        STR(INDEX_UNSIGNED, X1, X0, 0);
+        QuickTailCall(X0, ARM_Ret);
+        SetJumpTarget(notHot);
+    }
+
     Thumb = thumb;
     Num = cpu->Num;
     CurCPU = cpu;
@@ -667,6 +691,8 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
             : A_Comp[CurInstr.Info.Kind];
 
         Exit = i == (instrsCount - 1) || (CurInstr.BranchFlags & branch_FollowCondNotTaken);
+        ExitStatic = false;
+        ExitReturn = false;
 
         //printf("%x instr %x regs: r%x w%x n%x flags: %x %x %x\n", R15, CurInstr.Instr, CurInstr.Info.SrcRegs, CurInstr.Info.DstRegs, CurInstr.Info.ReadFlags, CurInstr.Info.NotStrictlyNeeded, CurInstr.Info.WriteFlags, CurInstr.SetFlags);
 
@@ -766,11 +792,29 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
             LoadCycles();
             LoadCPSR();
         }
+
+        if (i == instrsCount - 1)
+        {
+            if (comp == NULL || (CurInstr.Info.Branches() && isConditional))
+            {
+                ExitStatic = false;
+                ExitReturn = false;
+            }
+            else if (!CurInstr.Info.Branches())
+            {
+                ExitStatic = true;
+                ExitTarget = R15 - (Thumb ? 2 : 4);
+            }
+        }
     }
 
     RegCache.Flush();
 
     ADD(RCycles, RCycles, ConstantCycles);
+    if (ExitStatic)
+        Comp_LinkExit(ExitTarget);
+    else if (ExitReturn)
+        Comp_ReturnExit();
     QuickTailCall(X0, ARM_Ret);
 
     FlushIcache();
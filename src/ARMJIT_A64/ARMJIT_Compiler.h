@@ -90,7 +90,7 @@ public:
         return RegCache.Mapping[reg];
     }
 
-    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount);
+    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, JitBlock* tierUpBlock);
 
     bool CanCompile(bool thumb, u16 kind);
 
@@ -181,6 +181,11 @@ public:
     void Comp_JumpTo(Arm64Gen::ARM64Reg addr, bool switchThumb, bool restoreCPSR = false);
     void Comp_JumpTo(u32 addr, bool forceNonConstantCycles = false);
 
+    void Comp_PushReturnStack();
+    void Comp_FollowLink();
+    void Comp_LinkExit(u32 addr);
+    void Comp_ReturnExit();
+
     void A_Comp_GetOp2(bool S, Op2& op2);
 
     void Comp_RegShiftImm(int op, int amount, bool S, Op2& op2, Arm64Gen::ARM64Reg tmp = Arm64Gen::W0);
@@ -227,6 +232,11 @@ public:
 
     bool Exit;
 
+    // where the block continues after its last instruction, if that's known
+    bool ExitStatic;
+    u32 ExitTarget;
+    bool ExitReturn;
+
     FetchedInstr CurInstr;
     bool Thumb;
     u32 R15;
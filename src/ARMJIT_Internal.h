@@ -153,15 +153,73 @@ struct __attribute__((packed)) TinyVector
     }
 };
 
+/*
+    LinkCell
+        - a pointer in memory through which a block exit jumps to its successor
+        - points to LinkStub while unlinked, which returns to the dispatcher
+        and asks it to link the cell once the successor has been looked up
+        - a linked cell is kept in the Links of the block it points to, so
+        invalidating that block can unlink it again
+*/
+struct LinkCell
+{
+    void* Target;
+    u32 Addr; // block address | cpu num
+};
+
+/*
+    ReturnStack
+        - pushed by calls, popped by returns (BX LR, POP {..., PC}, ...)
+        - a return whose address matches the top entry follows its cell,
+        otherwise it goes through the dispatcher as usual
+*/
+const u32 ReturnStackSize = 16;
+
+struct ReturnStackEntry
+{
+    LinkCell* Cell;
+    u32 R15;
+    u32 Pad;
+};
+static_assert(sizeof(ReturnStackEntry) == 16, "the JIT indexes the return stack with a shift");
+
+struct ReturnStack
+{
+    ReturnStackEntry Entries[ReturnStackSize];
+    u32 Pos;
+};
+
+const int kCodeSegments = 8;
+
+void EvictCodeSegment(int segment, u8* start, u8* end, u32 unusedBytes);
+
+extern void* LinkStub;
+extern LinkCell* PendingLink;
+extern ReturnStack ReturnStacks[2];
+
+LinkCell* AllocLinkCell(u32 num, u32 addr);
+
+class JitBlock;
+extern JitBlock* PendingTierUp;
+
 class JitBlock
 {
 public:
+    JitBlock() {}
     JitBlock(u32 num, u32 literalHash, u32 numAddresses, u32 numLiterals)
+    {
+        Init(num, numAddresses, numLiterals);
+    }
+
+    // blocks are recycled, a reused block keeps the memory of its data array
+    void Init(u32 num, u32 numAddresses, u32 numLiterals)
     {
         Num = num;
         NumAddresses = numAddresses;
         NumLiterals = numLiterals;
         Data.SetLength(numAddresses * 2 + numLiterals);
+        Links.Clear();
+        Decoded.Clear();
     }
 
     u32 StartAddr;
@@ -173,6 +231,19 @@ public:
 
     JitBlockEntry EntryPoint;
 
+    // cells which currently jump into this block
+    TinyVector<LinkCell*> Links;
+
+    // counted down by baseline blocks, see TierUp
+    u32 TierUpCounter;
+
+    // position in the block slabs, never changes
+    u32 Index;
+
+    // only used by the decode cache, whose blocks have no EntryPoint
+    bool Thumb;
+    TinyVector<DecodedInstr> Decoded;
+
     u32* AddressRanges()
     { return &Data[0]; }
     u32* AddressMasks()
@@ -198,6 +269,8 @@ extern InterpreterFunc InterpretTHUMB[];
 
 extern TinyVector<u32> InvalidLiterals;
 
+bool IsVolatileLiteral(u32 localAddr);
+
 extern AddressRange* const CodeMemRegions[ARMJIT_Memory::memregions_Count];
 
 inline bool PageContainsCode(AddressRange* range)
@@ -440,6 +440,8 @@ void RemapDTCM(u32 newBase, u32 newSize)
 
 void RemapNWRAM(int num)
 {
+    ARMJIT::UnlinkAllBlocks();
+
     for (int i = 0; i < Mappings[memregion_SharedWRAM].Length;)
     {
         Mapping& mapping = Mappings[memregion_SharedWRAM][i];
@@ -464,6 +466,7 @@ void RemapNWRAM(int num)
 void RemapSWRAM()
 {
     printf("remapping SWRAM\n");
+    ARMJIT::UnlinkAllBlocks();
     for (int i = 0; i < Mappings[memregion_WRAM7].Length;)
     {
         Mapping& mapping = Mappings[memregion_WRAM7][i];
@@ -123,7 +123,11 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
     }
 
     if (Exit)
+    {
         MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(newPC));
+        ExitStatic = true;
+        ExitTarget = addr;
+    }
     if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
         ConstantCycles += cycles;
     else
@@ -172,16 +176,25 @@ void Compiler::A_Comp_BranchImm()
     }
 
     if (link)
+    {
         MOV(32, MapReg(14), Imm32(R15 - 4));
+        Comp_PushReturnStack();
+    }
 
     Comp_JumpTo(target);
 }
 
 void Compiler::A_Comp_BranchXchangeReg()
 {
+    bool link = (CurInstr.Instr & 0xF0) == 0x30; // BLX_reg
+    if (link)
+        Comp_PushReturnStack();
+    else if (CurInstr.A_Reg(0) == 14 && CurInstr.Cond() >= 0xE)
+        ExitReturn = true;
+
     OpArg rn = MapReg(CurInstr.A_Reg(0));
     MOV(32, R(RSCRATCH), rn);
-    if ((CurInstr.Instr & 0xF0) == 0x30) // BLX_reg
+    if (link)
         MOV(32, MapReg(14), Imm32(R15 - 4));
     Comp_JumpTo(RSCRATCH);
 }
@@ -222,12 +235,15 @@ void Compiler::T_Comp_BranchXchangeReg()
             printf("BLX unsupported on ARM7!!!\n");
             return;
         }
+        Comp_PushReturnStack();
         MOV(32, R(RSCRATCH), MapReg(CurInstr.A_Reg(3)));
         MOV(32, MapReg(14), Imm32(R15 - 1));
         Comp_JumpTo(RSCRATCH);
     }
     else
     {
+        ExitReturn = CurInstr.A_Reg(3) == 14;
+
         OpArg rn = MapReg(CurInstr.A_Reg(3));
         Comp_JumpTo(rn.GetSimpleReg());
     }
@@ -242,6 +258,8 @@ void Compiler::T_Comp_BL_LONG_1()
 
 void Compiler::T_Comp_BL_LONG_2()
 {
+    Comp_PushReturnStack();
+
     OpArg lr = MapReg(14);
     s32 offset = (CurInstr.Instr & 0x7FF) << 1;
     LEA(32, RSCRATCH, MDisp(lr.GetSimpleReg(), offset));
@@ -265,8 +283,85 @@ void Compiler::T_Comp_BL_Merged()
         target |= 1;
 
     MOV(32, MapReg(14), Imm32((R15 - 2) | 1));
-    
+    Comp_PushReturnStack();
+
     Comp_JumpTo(target);
 }
 
-}
\ No newline at end of file
+void Compiler::Comp_PushReturnStack()
+{
+    // the call returns to the instruction after it, in the current mode
+    LinkCell* cell = AllocLinkCell(Num, R15 - (Thumb ? 2 : 4));
+    if (!cell)
+        return;
+
+    MOV(64, R(RSCRATCH2), ImmPtr(&ReturnStacks[Num]));
+    MOV(32, R(RSCRATCH), MDisp(RSCRATCH2, offsetof(ReturnStack, Pos)));
+    ADD(32, R(RSCRATCH), Imm8(1));
+    AND(32, R(RSCRATCH), Imm8(ReturnStackSize - 1));
+    MOV(32, MDisp(RSCRATCH2, offsetof(ReturnStack, Pos)), R(RSCRATCH));
+    SHL(32, R(RSCRATCH), Imm8(4));
+    ADD(64, R(RSCRATCH2), R(RSCRATCH));
+    MOV(64, R(RSCRATCH), ImmPtr(cell));
+    MOV(64, MDisp(RSCRATCH2, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, Cell)), R(RSCRATCH));
+    MOV(32, MDisp(RSCRATCH2, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, R15)), Imm32(R15));
+}
+
+void Compiler::Comp_FollowLink()
+{
+    // expects the cell in RSCRATCH3 and falls through if the
+    // block has to return to the dispatcher instead
+
+    // the dispatcher would stop here as well
+    CMP(32, MDisp(RCPU, offsetof(ARM, StopExecution)), Imm8(0));
+    FixupBranch stop = J_CC(CC_NZ);
+
+    // do what the dispatcher loop does between two blocks
+    MOV(32, R(RSCRATCH), MDisp(RCPU, offsetof(ARM, Cycles)));
+    MOV(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(0));
+    MOV(64, R(RSCRATCH2), ImmPtr(Num == 0 ? &NDS::ARM9Timestamp : &NDS::ARM7Timestamp));
+    ADD(64, R(RSCRATCH), MatR(RSCRATCH2));
+    MOV(64, MatR(RSCRATCH2), R(RSCRATCH));
+    MOV(64, R(RSCRATCH2), ImmPtr(Num == 0 ? &NDS::ARM9Target : &NDS::ARM7Target));
+    CMP(64, R(RSCRATCH), MatR(RSCRATCH2));
+    FixupBranch outOfTime = J_CC(CC_AE);
+
+    // the next block expects the CPSR in memory to be up to date
+    MOV(32, MDisp(RCPU, offsetof(ARM, CPSR)), R(RCPSR));
+    JMPptr(MatR(RSCRATCH3));
+
+    SetJumpTarget(stop);
+    SetJumpTarget(outOfTime);
+}
+
+void Compiler::Comp_LinkExit(u32 addr)
+{
+    LinkCell* cell = AllocLinkCell(Num, addr);
+    if (!cell)
+        return;
+
+    MOV(64, R(RSCRATCH3), ImmPtr(cell));
+    Comp_FollowLink();
+}
+
+void Compiler::Comp_ReturnExit()
+{
+    MOV(64, R(RSCRATCH2), ImmPtr(&ReturnStacks[Num]));
+    MOV(32, R(RSCRATCH), MDisp(RSCRATCH2, offsetof(ReturnStack, Pos)));
+    LEA(32, RSCRATCH3, MDisp(RSCRATCH, -1));
+    AND(32, R(RSCRATCH3), Imm8(ReturnStackSize - 1));
+    MOV(32, MDisp(RSCRATCH2, offsetof(ReturnStack, Pos)), R(RSCRATCH3));
+    SHL(32, R(RSCRATCH), Imm8(4));
+    ADD(64, R(RSCRATCH2), R(RSCRATCH));
+
+    MOV(32, R(RSCRATCH), MDisp(RSCRATCH2, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, R15)));
+    CMP(32, R(RSCRATCH), MDisp(RCPU, offsetof(ARM, R[15])));
+    FixupBranch mispredicted = J_CC(CC_NE);
+
+    MOV(64, R(RSCRATCH3), MDisp(RSCRATCH2, offsetof(ReturnStack, Entries) + offsetof(ReturnStackEntry, Cell)));
+    Comp_FollowLink();
+
+    SetJumpTarget(mispredicted);
+}
+
+}
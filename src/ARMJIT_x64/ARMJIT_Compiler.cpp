@@ -410,6 +410,14 @@ Compiler::Compiler()
     }
 
     // move the region forward to prevent overwriting the generated functions
+    {
+        // RSCRATCH3 the cell which wants to be linked
+        LinkStub = GetWritableCodePtr();
+        MOV(64, R(RSCRATCH), ImmPtr(&PendingLink));
+        MOV(64, MatR(RSCRATCH), R(RSCRATCH3));
+        JMP((u8*)&ARM_Ret, true);
+    }
+
     CodeMemSize -= GetWritableCodePtr() - ResetStart;
     ResetStart = GetWritableCodePtr();
 
@@ -608,6 +616,7 @@ void Compiler::Reset()
 
     NearCode = NearStart;
     FarCode = FarStart;
+    CodeSegment = 0;
 
     LoadStorePatches.clear();
 }
@@ -632,17 +641,37 @@ void Compiler::Comp_SpecialBranchBehaviour(bool taken)
     }
 }
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount)
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, JitBlock* tierUpBlock)
 {
-    if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
-    {
-        printf("near reset\n");
-        ResetBlockCache();
-    }
-    if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
+    u32 nearSegmentSize = NearSize / kCodeSegments;
+    u32 farSegmentSize = FarSize / kCodeSegments;
+    u8* nearSegmentEnd = NearStart + (CodeSegment + 1) * nearSegmentSize;
+    u8* farSegmentEnd = FarStart + (CodeSegment + 1) * farSegmentSize;
+    if (nearSegmentEnd - GetWritableCodePtr() < 1024 * 32 // guess...
+        || farSegmentEnd - FarCode < 1024 * 32)
     {
-        printf("far reset\n");
-        ResetBlockCache();
+        u32 unused = (nearSegmentEnd - GetWritableCodePtr()) + (farSegmentEnd - FarCode);
+
+        CodeSegment = (CodeSegment + 1) % kCodeSegments;
+        u8* nearSegment = NearStart + CodeSegment * nearSegmentSize;
+        u8* farSegment = FarStart + CodeSegment * farSegmentSize;
+
+        EvictCodeSegment(CodeSegment, nearSegment, nearSegment + nearSegmentSize, unused);
+
+        for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+        {
+            if ((it->first >= nearSegment && it->first < nearSegment + nearSegmentSize)
+                || (it->first >= farSegment && it->first < farSegment + farSegmentSize))
+                it = LoadStorePatches.erase(it);
+            else
+                it++;
+        }
+
+        memset(nearSegment, 0xcc, nearSegmentSize);
+        memset(farSegment, 0xcc, farSegmentSize);
+        SetCodePtr(nearSegment);
+        NearCode = nearSegment;
+        FarCode = farSegment;
     }
 
     ConstantCycles = 0;
@@ -655,6 +684,20 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     JitBlockEntry res = (JitBlockEntry)GetWritableCodePtr();
 
+    if (tierUpBlock)
+    {
+        // leave before anything has been executed, so that the block
+        // can be recompiled and run from the start
+        MOV(64, R(RSCRATCH), ImmPtr(&tierUpBlock->TierUpCounter));
+        SUB(32, MatR(RSCRATCH), Imm8(1));
+        FixupBranch notHot = J_CC(CC_NZ);
+        MOV(64, R(RSCRATCH), ImmPtr(&PendingTierUp));
+        MOV(64, R(RSCRATCH2), ImmPtr(tierUpBlock));
+        MOV(64, MatR(RSCRATCH), R(RSCRATCH2));
+        JMP((u8*)&ARM_Ret, true);
+        SetJumpTarget(notHot);
+    }
+
     RegCache = RegisterCache<Compiler, X64Reg>(this, instrs, instrsCount);
 
     for (int i = 0; i < instrsCount; i++)
@@ -664,6 +707,8 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
         CodeRegion = R15 >> 24;
 
         Exit = i == instrsCount - 1 || (CurInstr.BranchFlags & branch_FollowCondNotTaken);
+        ExitStatic = false;
+        ExitReturn = false;
 
         CompileFunc comp = Thumb
             ? T_Comp[CurInstr.Info.Kind]
@@ -756,11 +801,29 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
         if (comp == NULL)
             LoadCPSR();
+
+        if (i == instrsCount - 1)
+        {
+            if (comp == NULL || (CurInstr.Info.Branches() && isConditional))
+            {
+                ExitStatic = false;
+                ExitReturn = false;
+            }
+            else if (!CurInstr.Info.Branches())
+            {
+                ExitStatic = true;
+                ExitTarget = R15 - (Thumb ? 2 : 4);
+            }
+        }
     }
 
     RegCache.Flush();
 
     ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
+    if (ExitStatic)
+        Comp_LinkExit(ExitTarget);
+    else if (ExitReturn)
+        Comp_ReturnExit();
     JMP((u8*)ARM_Ret, true);
 
     /*FILE* codeout = fopen("codeout", "a");
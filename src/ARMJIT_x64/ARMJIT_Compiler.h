@@ -61,7 +61,7 @@ public:
 
     void Reset();
 
-    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount);
+    JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, JitBlock* tierUpBlock);
 
     void LoadReg(int reg, Gen::X64Reg nativeReg);
     void SaveReg(int reg, Gen::X64Reg nativeReg);
@@ -73,6 +73,11 @@ public:
     void Comp_JumpTo(Gen::X64Reg addr, bool restoreCPSR = false);
     void Comp_JumpTo(u32 addr, bool forceNonConstantCycles = false);
 
+    void Comp_PushReturnStack();
+    void Comp_FollowLink();
+    void Comp_LinkExit(u32 addr);
+    void Comp_ReturnExit();
+
     void Comp_AddCycles_C(bool forceNonConstant = false);
     void Comp_AddCycles_CI(u32 i);
     void Comp_AddCycles_CI(Gen::X64Reg i, int add);
@@ -220,6 +225,9 @@ public:
     u8* NearStart;
     u8* FarStart;
 
+    // segment of the code buffer which is currently filled, see EvictCodeSegment
+    int CodeSegment;
+
     void* PatchedStoreFuncs[2][2][3][16];
     void* PatchedLoadFuncs[2][2][3][2][16];
 
@@ -231,6 +239,11 @@ public:
     bool Exit;
     bool IrregularCycles;
 
+    // where the block continues after its last instruction, if that's known
+    bool ExitStatic;
+    u32 ExitTarget;
+    bool ExitReturn;
+
     void* ReadBanked;
     void* WriteBanked;
 
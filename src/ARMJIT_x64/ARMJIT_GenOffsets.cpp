@@ -1,3 +1,5 @@
+#include <cstddef>
+
 #include "../ARM.h"
 
 int main(int argc, char* argv[])
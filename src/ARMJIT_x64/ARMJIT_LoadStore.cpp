@@ -64,6 +64,9 @@ bool Compiler::Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr)
         return false;
     }
 
+    if (IsVolatileLiteral(localAddr))
+        return false;
+
     Comp_AddCycles_CDI();
 
     u32 val;
@@ -725,6 +728,8 @@ void Compiler::A_Comp_LDM_STM()
 
     OpArg rn = MapReg(CurInstr.A_Reg(16));
 
+    ExitReturn = load && !usermode && regs[15] && CurInstr.A_Reg(16) == 13 && CurInstr.Cond() >= 0xE;
+
     s32 offset = Comp_MemAccessBlock(CurInstr.A_Reg(16), regs, !load, pre, !add, usermode);
 
     if (load && writeback && regs[CurInstr.A_Reg(16)])
@@ -801,6 +806,8 @@ void Compiler::T_Comp_PUSH_POP()
             regs[14] = true;
     }
 
+    ExitReturn = load && regs[15];
+
     OpArg sp = MapReg(13);
     s32 offset = Comp_MemAccessBlock(13, regs, !load, !load, !load, false);
 
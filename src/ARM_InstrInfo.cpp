@@ -368,8 +368,10 @@ Info Decode(bool thumb, u32 num, u32 instr)
         {
             if (res.Kind == tk_LDR_PCREL)
             {
+#ifdef JIT_ENABLED
                 if (!Config::JIT_LiteralOptimisations)
                     res.SrcRegs |= 1 << 15;
+#endif
                 res.SpecialKind = special_LoadLiteral;
             }
             else
@@ -539,4 +541,33 @@ Info Decode(bool thumb, u32 num, u32 instr)
     }
 }
 
+bool IsIdleLoop(bool thumb, const Info* info, int count)
+{
+    // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
+    // it basically checks if one iteration of a loop depends on another
+    // the rules are quite simple
+
+    u16 regsWrittenTo = 0;
+    u16 regsDisallowedToWrite = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (info[i].SpecialKind == special_WriteMem)
+            return false;
+        if (!thumb && info[i].Kind >= ak_MSR_IMM && info[i].Kind <= ak_MRC)
+            return false;
+        if (i < count - 1 && info[i].Branches())
+            return false;
+
+        u16 srcRegs = info[i].SrcRegs & ~(1 << 15);
+        u16 dstRegs = info[i].DstRegs & ~(1 << 15);
+
+        regsDisallowedToWrite |= srcRegs & ~regsWrittenTo;
+
+        if (dstRegs & regsDisallowedToWrite)
+            return false;
+        regsWrittenTo |= dstRegs;
+    }
+    return true;
+}
+
 }
@@ -258,6 +258,10 @@ struct Info
 
 Info Decode(bool thumb, u32 num, u32 instr);
 
+// checks whether the given instructions, ending with a backwards branch to the
+// first one, form a loop whose iterations don't depend on each other
+bool IsIdleLoop(bool thumb, const Info* info, int count);
+
 }
 
 #endif
\ No newline at end of file
@@ -767,6 +767,24 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
     return BusRead32(addr);
 }
 
+void ARMv5::CodeFetchCycles(u32 addr)
+{
+    if (addr < ITCMSize)
+    {
+        CodeCycles = 1;
+        return;
+    }
+
+    CodeCycles = RegionCodeCycles;
+    if (CodeCycles == 0xFF) // cached memory. hax
+    {
+        if (!(addr & 0x1F))
+            CodeCycles = kCodeCacheTiming;
+        else
+            CodeCycles = 1;
+    }
+}
+
 
 void ARMv5::DataRead8(u32 addr, u32* val)
 {
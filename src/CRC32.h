@@ -21,6 +21,6 @@
 
 #include "types.h"
 
-u32 CRC32(u8* data, int len);
+u32 CRC32(u8* data, int len, u32 start=0);
 
 #endif // CRC32_H
@@ -43,12 +43,24 @@ char DSiSDPath[1024];
 
 int RandomizeMAC;
 
+int SPU_BatchSize;
+
+int SaveFlushAsync;
+
+int ParallelCPUs;
+
+int IdleSkip;
+char IdleSkipGames[1024];
+
 #ifdef JIT_ENABLED
 int JIT_Enable = false;
 int JIT_MaxBlockSize = 32;
 int JIT_BranchOptimisations = 2;
 int JIT_LiteralOptimisations = true;
 int JIT_FastMemory = true;
+int JIT_PersistentCache = false;
+int JIT_TieredCompilation = false;
+int JIT_DecodeCache = true;
 #endif
 
 ConfigEntry ConfigFile[] =
@@ -68,12 +80,24 @@ ConfigEntry ConfigFile[] =
 
     {"RandomizeMAC", 0, &RandomizeMAC, 0, NULL, 0},
 
+    {"SPU_BatchSize", 0, &SPU_BatchSize, 1, NULL, 0},
+
+    {"SaveFlushAsync", 0, &SaveFlushAsync, 1, NULL, 0},
+
+    {"ParallelCPUs", 0, &ParallelCPUs, 0, NULL, 0},
+
+    {"IdleSkip", 0, &IdleSkip, 0, NULL, 0},
+    {"IdleSkipGames", 1, IdleSkipGames, 0, "", 1023},
+
 #ifdef JIT_ENABLED
     {"JIT_Enable", 0, &JIT_Enable, 0, NULL, 0},
     {"JIT_MaxBlockSize", 0, &JIT_MaxBlockSize, 32, NULL, 0},
     {"JIT_BranchOptimisations", 0, &JIT_BranchOptimisations, 2, NULL, 0},
     {"JIT_LiteralOptimisations", 0, &JIT_LiteralOptimisations, 1, NULL, 0},
     {"JIT_FastMemory", 0, &JIT_FastMemory, 1, NULL, 0},
+    {"JIT_PersistentCache", 0, &JIT_PersistentCache, 0, NULL, 0},
+    {"JIT_TieredCompilation", 0, &JIT_TieredCompilation, 0, NULL, 0},
+    {"JIT_DecodeCache", 0, &JIT_DecodeCache, 1, NULL, 0},
 #endif
 
     {"", -1, NULL, 0, NULL, 0}
@@ -57,12 +57,24 @@ extern char DSiSDPath[1024];
 
 extern int RandomizeMAC;
 
+extern int SPU_BatchSize;
+
+extern int SaveFlushAsync;
+
+extern int ParallelCPUs;
+
+extern int IdleSkip;
+extern char IdleSkipGames[1024];
+
 #ifdef JIT_ENABLED
 extern int JIT_Enable;
 extern int JIT_MaxBlockSize;
 extern int JIT_BranchOptimisations;
 extern int JIT_LiteralOptimisations;
 extern int JIT_FastMemory;
+extern int JIT_PersistentCache;
+extern int JIT_TieredCompilation;
+extern int JIT_DecodeCache;
 #endif
 
 }
@@ -17,11 +17,17 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "NDS.h"
 #include "DSi.h"
 #include "DMA.h"
 #include "GPU.h"
 
+#ifdef JIT_ENABLED
+#include "ARMJIT.h"
+#include "ARMJIT_Memory.h"
+#endif
+
 
 
 // DMA TIMINGS
@@ -39,6 +45,14 @@
 //   another DMA (TODO: check)
 // * applied to all accesses for mainRAM->mainRAM, resulting in timings of 16-18 cycles per unit
 //
+// BURST TRANSFERS
+//
+// when both source and destination are plain memory (main RAM, WRAM, BIOS for reading)
+// the transfer is done with one copy or fill per contiguous run instead of going through
+// the bus functions for every unit. the timing is the same as for the unit loop, the
+// cycles for all the units that would have run before reaching the CPU target are added
+// at once.
+//
 // TODO: GBA slot
 // TODO: re-add initial NS delay
 // TODO: timings are nonseq when address is fixed/decrementing
@@ -198,6 +212,147 @@ void DMA::Start()
     NDS::StopCPU(CPU, 1<<Num);
 }
 
+static bool GetBusMemRegion(u32 cpu, u32 addr, bool write, NDS::MemRegion* region)
+{
+    if (NDS::ConsoleType == 1)
+    {
+        if (cpu == 0) return DSi::ARM9GetMemRegion(addr, write, region);
+        else          return DSi::ARM7GetMemRegion(addr, write, region);
+    }
+    else
+    {
+        if (cpu == 0) return NDS::ARM9GetMemRegion(addr, write, region);
+        else          return NDS::ARM7GetMemRegion(addr, write, region);
+    }
+}
+
+u32 DMA::CopyBurst(u32 unitsize, u32 maxunits)
+{
+    if (DstAddrInc != 1 || (SrcAddrInc != 1 && SrcAddrInc != 0))
+        return 0;
+    if ((CurSrcAddr | CurDstAddr) & (unitsize-1))
+        return 0;
+
+    NDS::MemRegion dst;
+    if (!GetBusMemRegion(CPU, CurDstAddr, true, &dst))
+        return 0;
+
+    u32 dstoffset = CurDstAddr & dst.Mask;
+    u8* dstptr = &dst.Mem[dstoffset];
+
+    u32 num = maxunits;
+    if (num > (dst.Mask + 1 - dstoffset) / unitsize)
+        num = (dst.Mask + 1 - dstoffset) / unitsize;
+
+    if (SrcAddrInc == 0)
+    {
+        u32 val;
+        if (CPU == 0 && (CurSrcAddr & 0xFFFFFFF0) == 0x040000E0)
+        {
+            // DMA fill registers
+            val = (unitsize == 2) ? BusRead16(CurSrcAddr) : BusRead32(CurSrcAddr);
+        }
+        else
+        {
+            NDS::MemRegion src;
+            if (!GetBusMemRegion(CPU, CurSrcAddr, false, &src))
+                return 0;
+
+            u8* srcptr = &src.Mem[CurSrcAddr & src.Mask];
+            val = (unitsize == 2) ? *(u16*)srcptr : *(u32*)srcptr;
+        }
+
+        if (unitsize == 2)
+        {
+            for (u32 i = 0; i < num; i++)
+                ((u16*)dstptr)[i] = val;
+        }
+        else
+        {
+            for (u32 i = 0; i < num; i++)
+                ((u32*)dstptr)[i] = val;
+        }
+    }
+    else
+    {
+        NDS::MemRegion src;
+        if (!GetBusMemRegion(CPU, CurSrcAddr, false, &src))
+            return 0;
+
+        u32 srcoffset = CurSrcAddr & src.Mask;
+        u8* srcptr = &src.Mem[srcoffset];
+
+        if (num > (src.Mask + 1 - srcoffset) / unitsize)
+            num = (src.Mask + 1 - srcoffset) / unitsize;
+
+        // units are copied forward one at a time, so a destination starting within
+        // the source data repeats what's in between. stop the run before that point.
+        if (dstptr > srcptr && dstptr < srcptr + num*unitsize)
+            num = (dstptr - srcptr) / unitsize;
+
+        memmove(dstptr, srcptr, num*unitsize);
+    }
+
+#ifdef JIT_ENABLED
+    int region;
+    if (dst.Mem == NDS::MainRAM)
+        region = ARMJIT_Memory::memregion_MainRAM;
+    else if (dst.Mem == NDS::ARM7WRAM)
+        region = ARMJIT_Memory::memregion_WRAM7;
+    else
+        region = ARMJIT_Memory::memregion_SharedWRAM;
+    ARMJIT::CheckAndInvalidateRange(CPU, region, CurDstAddr, num*unitsize);
+#endif
+
+    CurSrcAddr += SrcAddrInc * num*unitsize;
+    CurDstAddr += num*unitsize;
+    IterCount -= num;
+    RemCount -= num;
+
+    return num;
+}
+
+bool DMA::RunBurst9(s32 unitcycles, u32 unitsize)
+{
+    // returns true if the target was reached, in which case
+    // the unit loop would have stopped there too
+    u64 cycles = (u64)unitcycles << NDS::ARM9ClockShift;
+
+    while (IterCount > 0)
+    {
+        // the unit loop runs at least one unit, and stops right after the one that reaches the target
+        u64 maxunits = 1;
+        if (NDS::ARM9Timestamp < NDS::ARM9Target)
+            maxunits = (NDS::ARM9Target - NDS::ARM9Timestamp + cycles - 1) / cycles;
+        u32 num = CopyBurst(unitsize, (maxunits < IterCount) ? (u32)maxunits : IterCount);
+        if (!num) break;
+
+        NDS::ARM9Timestamp += cycles * num;
+        if (NDS::ARM9Timestamp >= NDS::ARM9Target) return true;
+    }
+
+    return false;
+}
+
+bool DMA::RunBurst7(s32 unitcycles, u32 unitsize)
+{
+    u64 cycles = unitcycles;
+
+    while (IterCount > 0)
+    {
+        u64 maxunits = 1;
+        if (NDS::ARM7Timestamp < NDS::ARM7Target)
+            maxunits = (NDS::ARM7Target - NDS::ARM7Timestamp + cycles - 1) / cycles;
+        u32 num = CopyBurst(unitsize, (maxunits < IterCount) ? (u32)maxunits : IterCount);
+        if (!num) break;
+
+        NDS::ARM7Timestamp += cycles * num;
+        if (NDS::ARM7Timestamp >= NDS::ARM7Target) return true;
+    }
+
+    return false;
+}
+
 void DMA::Run()
 {
     if (!Running) return;
@@ -238,18 +393,21 @@ void DMA::Run9()
             }*/
         }
 
-        while (IterCount > 0 && !Stall)
+        if (!RunBurst9(unitcycles, 2))
         {
-            NDS::ARM9Timestamp += (unitcycles << NDS::ARM9ClockShift);
+            while (IterCount > 0 && !Stall)
+            {
+                NDS::ARM9Timestamp += (unitcycles << NDS::ARM9ClockShift);
 
-            BusWrite16(CurDstAddr, BusRead16(CurSrcAddr));
+                BusWrite16(CurDstAddr, BusRead16(CurSrcAddr));
 
-            CurSrcAddr += SrcAddrInc<<1;
-            CurDstAddr += DstAddrInc<<1;
-            IterCount--;
-            RemCount--;
+                CurSrcAddr += SrcAddrInc<<1;
+                CurDstAddr += DstAddrInc<<1;
+                IterCount--;
+                RemCount--;
 
-            if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+                if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+            }
         }
     }
     else
@@ -274,18 +432,21 @@ void DMA::Run9()
             }*/
         }
 
-        while (IterCount > 0 && !Stall)
+        if (!RunBurst9(unitcycles, 4))
         {
-            NDS::ARM9Timestamp += (unitcycles << NDS::ARM9ClockShift);
+            while (IterCount > 0 && !Stall)
+            {
+                NDS::ARM9Timestamp += (unitcycles << NDS::ARM9ClockShift);
 
-            BusWrite32(CurDstAddr, BusRead32(CurSrcAddr));
+                BusWrite32(CurDstAddr, BusRead32(CurSrcAddr));
 
-            CurSrcAddr += SrcAddrInc<<2;
-            CurDstAddr += DstAddrInc<<2;
-            IterCount--;
-            RemCount--;
+                CurSrcAddr += SrcAddrInc<<2;
+                CurDstAddr += DstAddrInc<<2;
+                IterCount--;
+                RemCount--;
 
-            if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+                if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+            }
         }
     }
 
@@ -350,18 +511,21 @@ void DMA::Run7()
             }*/
         }
 
-        while (IterCount > 0 && !Stall)
+        if (!RunBurst7(unitcycles, 2))
         {
-            NDS::ARM7Timestamp += unitcycles;
+            while (IterCount > 0 && !Stall)
+            {
+                NDS::ARM7Timestamp += unitcycles;
 
-            BusWrite16(CurDstAddr, BusRead16(CurSrcAddr));
+                BusWrite16(CurDstAddr, BusRead16(CurSrcAddr));
 
-            CurSrcAddr += SrcAddrInc<<1;
-            CurDstAddr += DstAddrInc<<1;
-            IterCount--;
-            RemCount--;
+                CurSrcAddr += SrcAddrInc<<1;
+                CurDstAddr += DstAddrInc<<1;
+                IterCount--;
+                RemCount--;
 
-            if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+                if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+            }
         }
     }
     else
@@ -386,18 +550,21 @@ void DMA::Run7()
             }*/
         }
 
-        while (IterCount > 0 && !Stall)
+        if (!RunBurst7(unitcycles, 4))
         {
-            NDS::ARM7Timestamp += unitcycles;
+            while (IterCount > 0 && !Stall)
+            {
+                NDS::ARM7Timestamp += unitcycles;
 
-            BusWrite32(CurDstAddr, BusRead32(CurSrcAddr));
+                BusWrite32(CurDstAddr, BusRead32(CurSrcAddr));
 
-            CurSrcAddr += SrcAddrInc<<2;
-            CurDstAddr += DstAddrInc<<2;
-            IterCount--;
-            RemCount--;
+                CurSrcAddr += SrcAddrInc<<2;
+                CurDstAddr += DstAddrInc<<2;
+                IterCount--;
+                RemCount--;
 
-            if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+                if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+            }
         }
     }
 
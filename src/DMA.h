@@ -39,6 +39,10 @@ public:
     void Run9();
     void Run7();
 
+    u32 CopyBurst(u32 unitsize, u32 maxunits);
+    bool RunBurst9(s32 unitcycles, u32 unitsize);
+    bool RunBurst7(s32 unitcycles, u32 unitsize);
+
     bool IsInMode(u32 mode)
     {
         return ((mode == StartMode) && (Cnt & 0x80000000));
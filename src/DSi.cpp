@@ -36,8 +36,6 @@
 #include "DSi_SD.h"
 #include "DSi_AES.h"
 
-#include "tiny-AES-c/aes.hpp"
-
 
 namespace DSi
 {
@@ -195,6 +193,9 @@ void SoftReset()
 
     DSi_AES::Reset();
 
+    // LoadNAND() reads the image file directly, it needs to see
+    // the blocks still held in the NAND's write-back cache
+    SDMMC->FlushStorage();
     LoadNAND();
 
     SDMMC->Reset();
@@ -360,60 +361,41 @@ bool LoadNAND()
 
         // load boot2 binaries
 
-        AES_ctx ctx;
         const u8 boot2key[16] = {0xAD, 0x34, 0xEC, 0xF9, 0x62, 0x6E, 0xC2, 0x3A, 0xF6, 0xB4, 0x6C, 0x00, 0x80, 0x80, 0xEE, 0x98};
+        u8 boot2key_rev[16];
         u8 boot2iv[16];
-        u8 tmp[16];
-        u32 dstaddr;
-
-        *(u32*)&tmp[0] = bootparams[3];
-        *(u32*)&tmp[4] = -bootparams[3];
-        *(u32*)&tmp[8] = ~bootparams[3];
-        *(u32*)&tmp[12] = 0;
-        for (int i = 0; i < 16; i++) boot2iv[i] = tmp[15-i];
+        for (int i = 0; i < 16; i++) boot2key_rev[i] = boot2key[15-i];
 
-        AES_init_ctx_iv(&ctx, boot2key, boot2iv);
+        // read each binary in one go, then decrypt it in place
 
-        fseek(f, bootparams[0], SEEK_SET);
-        dstaddr = bootparams[2];
-        for (u32 i = 0; i < bootparams[3]; i += 16)
+        for (int cpu = 0; cpu < 2; cpu++)
         {
-            u8 data[16];
-            fread(data, 16, 1, f);
+            u32 offset = bootparams[cpu*4 + 0];
+            u32 dstaddr = bootparams[cpu*4 + 2];
+            u32 size = bootparams[cpu*4 + 3];
+            u32 size_blocks = (size + 15) & ~15;
 
-            for (int j = 0; j < 16; j++) tmp[j] = data[15-j];
-            AES_CTR_xcrypt_buffer(&ctx, tmp, 16);
-            for (int j = 0; j < 16; j++) data[j] = tmp[15-j];
+            *(u32*)&boot2iv[0] = size;
+            *(u32*)&boot2iv[4] = -size;
+            *(u32*)&boot2iv[8] = ~size;
+            *(u32*)&boot2iv[12] = 0;
 
-            ARM9Write32(dstaddr, *(u32*)&data[0]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[4]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[8]); dstaddr += 4;
-            ARM9Write32(dstaddr, *(u32*)&data[12]); dstaddr += 4;
-        }
+            u8* boot2 = new u8[size_blocks];
+            memset(boot2, 0, size_blocks);
 
-        *(u32*)&tmp[0] = bootparams[7];
-        *(u32*)&tmp[4] = -bootparams[7];
-        *(u32*)&tmp[8] = ~bootparams[7];
-        *(u32*)&tmp[12] = 0;
-        for (int i = 0; i < 16; i++) boot2iv[i] = tmp[15-i];
+            fseek(f, offset, SEEK_SET);
+            fread(boot2, 1, size_blocks, f);
 
-        AES_init_ctx_iv(&ctx, boot2key, boot2iv);
+            DSi_AES::ApplyModcrypt(boot2, size_blocks, boot2key_rev, boot2iv);
 
-        fseek(f, bootparams[4], SEEK_SET);
-        dstaddr = bootparams[6];
-        for (u32 i = 0; i < bootparams[7]; i += 16)
-        {
-            u8 data[16];
-            fread(data, 16, 1, f);
-
-            for (int j = 0; j < 16; j++) tmp[j] = data[15-j];
-            AES_CTR_xcrypt_buffer(&ctx, tmp, 16);
-            for (int j = 0; j < 16; j++) data[j] = tmp[15-j];
+            for (u32 i = 0; i < size_blocks; i += 4)
+            {
+                if (cpu == 0) ARM9Write32(dstaddr, *(u32*)&boot2[i]);
+                else          ARM7Write32(dstaddr, *(u32*)&boot2[i]);
+                dstaddr += 4;
+            }
 
-            ARM7Write32(dstaddr, *(u32*)&data[0]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[4]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[8]); dstaddr += 4;
-            ARM7Write32(dstaddr, *(u32*)&data[12]); dstaddr += 4;
+            delete[] boot2;
         }
 
         // repoint the CPUs to the boot2 binaries
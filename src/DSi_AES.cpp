@@ -24,6 +24,15 @@
 #include "tiny-AES-c/aes.hpp"
 #include "Platform.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define AES_HW_X64
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#include <arm_neon.h>
+#define AES_HW_ARM64
+#endif
+
 
 namespace DSi_AES
 {
@@ -58,6 +67,15 @@ bool OutputMACDue;
 
 AES_ctx Ctx;
 
+enum
+{
+    Backend_Software = 0,
+    Backend_AESNI,
+    Backend_ARMv8,
+};
+
+int Backend;
+
 
 void Swap16(u8* dst, u8* src)
 {
@@ -82,6 +100,253 @@ void ROL16(u8* val, u32 n)
     }
 }
 
+
+// AES primitives
+// data blocks are in DSi byte order, which is reversed compared to what
+// tiny-AES works with. the software backend swaps every block, the hardware
+// ones fold the reversal into the keystream and MAC instead.
+// MACs and the CTR counter (ctx->Iv) are kept in tiny-AES order.
+
+void IncrementCounter(u8* ctr)
+{
+    for (int i = 15; i >= 0; i--)
+    {
+        if (++ctr[i] != 0) break;
+    }
+}
+
+#ifdef AES_HW_X64
+
+__attribute__((target("aes,ssse3")))
+inline __m128i AESNI_Encrypt(const __m128i* rk, __m128i block)
+{
+    block = _mm_xor_si128(block, rk[0]);
+    for (int r = 1; r < 10; r++)
+        block = _mm_aesenc_si128(block, rk[r]);
+    return _mm_aesenclast_si128(block, rk[10]);
+}
+
+__attribute__((target("aes,ssse3")))
+void AESNI_CTR(AES_ctx* ctx, u8* data, u32 num, bool swapped)
+{
+    __m128i rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[r*16]);
+
+    const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    // four blocks at a time, to keep the AES units busy
+    while (num >= 4)
+    {
+        __m128i ks[4];
+        for (int i = 0; i < 4; i++)
+        {
+            ks[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)ctx->Iv), rk[0]);
+            IncrementCounter(ctx->Iv);
+        }
+        for (int r = 1; r < 10; r++)
+        {
+            for (int i = 0; i < 4; i++)
+                ks[i] = _mm_aesenc_si128(ks[i], rk[r]);
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            ks[i] = _mm_aesenclast_si128(ks[i], rk[10]);
+            if (swapped) ks[i] = _mm_shuffle_epi8(ks[i], rev);
+
+            __m128i* blk = (__m128i*)&data[i*16];
+            _mm_storeu_si128(blk, _mm_xor_si128(_mm_loadu_si128(blk), ks[i]));
+        }
+
+        data += 64;
+        num -= 4;
+    }
+
+    while (num > 0)
+    {
+        __m128i ks = AESNI_Encrypt(rk, _mm_loadu_si128((const __m128i*)ctx->Iv));
+        IncrementCounter(ctx->Iv);
+        if (swapped) ks = _mm_shuffle_epi8(ks, rev);
+
+        __m128i* blk = (__m128i*)data;
+        _mm_storeu_si128(blk, _mm_xor_si128(_mm_loadu_si128(blk), ks));
+
+        data += 16;
+        num--;
+    }
+}
+
+__attribute__((target("aes,ssse3")))
+void AESNI_MAC(const AES_ctx* ctx, u8* mac, const u8* data, u32 num)
+{
+    __m128i rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[r*16]);
+
+    const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    __m128i m = _mm_loadu_si128((const __m128i*)mac);
+    for (u32 i = 0; i < num; i++)
+    {
+        __m128i blk = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&data[i*16]), rev);
+        m = AESNI_Encrypt(rk, _mm_xor_si128(m, blk));
+    }
+    _mm_storeu_si128((__m128i*)mac, m);
+}
+
+__attribute__((target("aes,ssse3")))
+void AESNI_ECB(const AES_ctx* ctx, u8* block)
+{
+    __m128i rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = _mm_loadu_si128((const __m128i*)&ctx->RoundKey[r*16]);
+
+    __m128i blk = _mm_loadu_si128((const __m128i*)block);
+    _mm_storeu_si128((__m128i*)block, AESNI_Encrypt(rk, blk));
+}
+
+#endif // AES_HW_X64
+
+#ifdef AES_HW_ARM64
+
+inline uint8x16_t ARMv8_Encrypt(const uint8x16_t* rk, uint8x16_t block)
+{
+    for (int r = 0; r < 9; r++)
+        block = vaesmcq_u8(vaeseq_u8(block, rk[r]));
+    block = vaeseq_u8(block, rk[9]);
+    return veorq_u8(block, rk[10]);
+}
+
+inline uint8x16_t ARMv8_Reverse(uint8x16_t block)
+{
+    block = vrev64q_u8(block);
+    return vextq_u8(block, block, 8);
+}
+
+void ARMv8_CTR(AES_ctx* ctx, u8* data, u32 num, bool swapped)
+{
+    uint8x16_t rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = vld1q_u8(&ctx->RoundKey[r*16]);
+
+    while (num >= 4)
+    {
+        uint8x16_t ks[4];
+        for (int i = 0; i < 4; i++)
+        {
+            ks[i] = vld1q_u8(ctx->Iv);
+            IncrementCounter(ctx->Iv);
+        }
+        for (int r = 0; r < 9; r++)
+        {
+            for (int i = 0; i < 4; i++)
+                ks[i] = vaesmcq_u8(vaeseq_u8(ks[i], rk[r]));
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            ks[i] = veorq_u8(vaeseq_u8(ks[i], rk[9]), rk[10]);
+            if (swapped) ks[i] = ARMv8_Reverse(ks[i]);
+
+            vst1q_u8(&data[i*16], veorq_u8(vld1q_u8(&data[i*16]), ks[i]));
+        }
+
+        data += 64;
+        num -= 4;
+    }
+
+    while (num > 0)
+    {
+        uint8x16_t ks = ARMv8_Encrypt(rk, vld1q_u8(ctx->Iv));
+        IncrementCounter(ctx->Iv);
+        if (swapped) ks = ARMv8_Reverse(ks);
+
+        vst1q_u8(data, veorq_u8(vld1q_u8(data), ks));
+
+        data += 16;
+        num--;
+    }
+}
+
+void ARMv8_MAC(const AES_ctx* ctx, u8* mac, const u8* data, u32 num)
+{
+    uint8x16_t rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = vld1q_u8(&ctx->RoundKey[r*16]);
+
+    uint8x16_t m = vld1q_u8(mac);
+    for (u32 i = 0; i < num; i++)
+        m = ARMv8_Encrypt(rk, veorq_u8(m, ARMv8_Reverse(vld1q_u8(&data[i*16]))));
+    vst1q_u8(mac, m);
+}
+
+void ARMv8_ECB(const AES_ctx* ctx, u8* block)
+{
+    uint8x16_t rk[11];
+    for (int r = 0; r < 11; r++)
+        rk[r] = vld1q_u8(&ctx->RoundKey[r*16]);
+
+    vst1q_u8(block, ARMv8_Encrypt(rk, vld1q_u8(block)));
+}
+
+#endif // AES_HW_ARM64
+
+// CTR en/decryption of num blocks. if swapped, the blocks are in DSi order
+void Crypt_CTR(AES_ctx* ctx, u8* data, u32 num, bool swapped)
+{
+#ifdef AES_HW_X64
+    if (Backend == Backend_AESNI) { AESNI_CTR(ctx, data, num, swapped); return; }
+#endif
+#ifdef AES_HW_ARM64
+    if (Backend == Backend_ARMv8) { ARMv8_CTR(ctx, data, num, swapped); return; }
+#endif
+
+    if (!swapped)
+    {
+        AES_CTR_xcrypt_buffer(ctx, data, num*16);
+        return;
+    }
+
+    u8 data_rev[16];
+    for (u32 i = 0; i < num; i++)
+    {
+        Swap16(data_rev, &data[i*16]);
+        AES_CTR_xcrypt_buffer(ctx, data_rev, 16);
+        Swap16(&data[i*16], data_rev);
+    }
+}
+
+// CBC-MAC over num blocks in DSi order
+void Update_MAC(const AES_ctx* ctx, u8* mac, const u8* data, u32 num)
+{
+#ifdef AES_HW_X64
+    if (Backend == Backend_AESNI) { AESNI_MAC(ctx, mac, data, num); return; }
+#endif
+#ifdef AES_HW_ARM64
+    if (Backend == Backend_ARMv8) { ARMv8_MAC(ctx, mac, data, num); return; }
+#endif
+
+    u8 data_rev[16];
+    for (u32 i = 0; i < num; i++)
+    {
+        Swap16(data_rev, (u8*)&data[i*16]);
+        for (int j = 0; j < 16; j++) mac[j] ^= data_rev[j];
+        AES_ECB_encrypt(ctx, mac);
+    }
+}
+
+void Encrypt_ECB(const AES_ctx* ctx, u8* block)
+{
+#ifdef AES_HW_X64
+    if (Backend == Backend_AESNI) { AESNI_ECB(ctx, block); return; }
+#endif
+#ifdef AES_HW_ARM64
+    if (Backend == Backend_ARMv8) { ARMv8_ECB(ctx, block); return; }
+#endif
+
+    AES_ECB_encrypt(ctx, block);
+}
+
+
 #define _printhex(str, size) { for (int z = 0; z < (size); z++) printf("%02X", (str)[z]); printf("\n"); }
 #define _printhex2(str, size) { for (int z = 0; z < (size); z++) printf("%02X", (str)[z]); }
 
@@ -97,6 +362,15 @@ bool Init()
     const u8 zero[16] = {0};
     AES_init_ctx_iv(&Ctx, zero, zero);
 
+    Backend = Backend_Software;
+#if defined(AES_HW_X64)
+    u32 eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) && (ecx & bit_SSSE3))
+        Backend = Backend_AESNI;
+#elif defined(AES_HW_ARM64)
+    Backend = Backend_ARMv8;
+#endif
+
     return true;
 }
 
@@ -159,84 +433,33 @@ void Reset()
 }
 
 
-void ProcessBlock_CCM_Decrypt()
+void ProcessBlocks(u32 num)
 {
-    u8 data[16];
-    u8 data_rev[16];
+    u8 data[16*4];
 
-    *(u32*)&data[0] = InputFIFO->Read();
-    *(u32*)&data[4] = InputFIFO->Read();
-    *(u32*)&data[8] = InputFIFO->Read();
-    *(u32*)&data[12] = InputFIFO->Read();
+    for (u32 i = 0; i < num*4; i++)
+        *(u32*)&data[i*4] = InputFIFO->Read();
 
-    //printf("AES-CCM: "); _printhex2(data, 16);
-
-    Swap16(data_rev, data);
-
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    for (int i = 0; i < 16; i++) CurMAC[i] ^= data_rev[i];
-    AES_ECB_encrypt(&Ctx, CurMAC);
-
-    Swap16(data, data_rev);
-
-    //printf(" -> "); _printhex2(data, 16);
-
-    OutputFIFO->Write(*(u32*)&data[0]);
-    OutputFIFO->Write(*(u32*)&data[4]);
-    OutputFIFO->Write(*(u32*)&data[8]);
-    OutputFIFO->Write(*(u32*)&data[12]);
-}
-
-void ProcessBlock_CCM_Encrypt()
-{
-    u8 data[16];
-    u8 data_rev[16];
-
-    *(u32*)&data[0] = InputFIFO->Read();
-    *(u32*)&data[4] = InputFIFO->Read();
-    *(u32*)&data[8] = InputFIFO->Read();
-    *(u32*)&data[12] = InputFIFO->Read();
-
-    //printf("AES-CCM: "); _printhex2(data, 16);
-
-    Swap16(data_rev, data);
-
-    for (int i = 0; i < 16; i++) CurMAC[i] ^= data_rev[i];
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    AES_ECB_encrypt(&Ctx, CurMAC);
-
-    Swap16(data, data_rev);
-
-    //printf(" -> "); _printhex2(data, 16);
-
-    OutputFIFO->Write(*(u32*)&data[0]);
-    OutputFIFO->Write(*(u32*)&data[4]);
-    OutputFIFO->Write(*(u32*)&data[8]);
-    OutputFIFO->Write(*(u32*)&data[12]);
-}
-
-void ProcessBlock_CTR()
-{
-    u8 data[16];
-    u8 data_rev[16];
-
-    *(u32*)&data[0] = InputFIFO->Read();
-    *(u32*)&data[4] = InputFIFO->Read();
-    *(u32*)&data[8] = InputFIFO->Read();
-    *(u32*)&data[12] = InputFIFO->Read();
-
-    //printf("AES-CTR: "); _printhex2(data, 16);
-
-    Swap16(data_rev, data);
-    AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-    Swap16(data, data_rev);
-
-    //printf(" -> "); _printhex(data, 16);
+    switch (AESMode)
+    {
+    case 0: // CCM decrypt
+        Crypt_CTR(&Ctx, data, num, true);
+        Update_MAC(&Ctx, CurMAC, data, num);
+        break;
+
+    case 1: // CCM encrypt
+        Update_MAC(&Ctx, CurMAC, data, num);
+        Crypt_CTR(&Ctx, data, num, true);
+        break;
+
+    case 2:
+    case 3: // CTR
+        Crypt_CTR(&Ctx, data, num, true);
+        break;
+    }
 
-    OutputFIFO->Write(*(u32*)&data[0]);
-    OutputFIFO->Write(*(u32*)&data[4]);
-    OutputFIFO->Write(*(u32*)&data[8]);
-    OutputFIFO->Write(*(u32*)&data[12]);
+    for (u32 i = 0; i < num*4; i++)
+        OutputFIFO->Write(*(u32*)&data[i*4]);
 }
 
 
@@ -312,7 +535,7 @@ void WriteCnt(u32 val)
                 iv[15] = RemBlocks << 4;
 
                 memcpy(CurMAC, iv, 16);
-                AES_ECB_encrypt(&Ctx, CurMAC);
+                Encrypt_ECB(&Ctx, CurMAC);
             }
             else
             {
@@ -407,17 +630,16 @@ void CheckOutputDMA()
 
 void Update()
 {
-    while (InputFIFO->Level() >= 4 && OutputFIFO->Level() <= 12 && RemBlocks > 0)
-    {
-        switch (AESMode)
-        {
-        case 0: ProcessBlock_CCM_Decrypt(); break;
-        case 1: ProcessBlock_CCM_Encrypt(); break;
-        case 2:
-        case 3: ProcessBlock_CTR(); break;
-        }
+    // process as many blocks as the FIFOs allow in one go
+    u32 num = InputFIFO->Level() >> 2;
+    u32 space = (16 - OutputFIFO->Level()) >> 2;
+    if (num > space) num = space;
+    if (num > RemBlocks) num = RemBlocks;
 
-        RemBlocks--;
+    if (num > 0)
+    {
+        ProcessBlocks(num);
+        RemBlocks -= num;
     }
 
     CheckOutputDMA();
@@ -429,7 +651,7 @@ void Update()
             Ctx.Iv[13] = 0x00;
             Ctx.Iv[14] = 0x00;
             Ctx.Iv[15] = 0x00;
-            AES_CTR_xcrypt_buffer(&Ctx, CurMAC, 16);
+            Crypt_CTR(&Ctx, CurMAC, 1, false);
 
             //printf("FINAL MAC: "); _printhexR(CurMAC, 16);
             //printf("INPUT MAC: "); _printhex(MAC, 16);
@@ -445,7 +667,7 @@ void Update()
             Ctx.Iv[13] = 0x00;
             Ctx.Iv[14] = 0x00;
             Ctx.Iv[15] = 0x00;
-            AES_CTR_xcrypt_buffer(&Ctx, CurMAC, 16);
+            Crypt_CTR(&Ctx, CurMAC, 1, false);
 
             Swap16(OutputMAC, CurMAC);
             OutputMACDue = true;
@@ -587,24 +809,13 @@ void GetModcryptKey(u8* romheader, u8* key)
 void ApplyModcrypt(u8* data, u32 len, u8* key, u8* iv)
 {
     u8 key_rev[16], iv_rev[16];
-    u8 data_rev[16];
-    u8 oldkeys[16*2];
-    memcpy(&oldkeys[16*0], Ctx.RoundKey, 16);
-    memcpy(&oldkeys[16*1], Ctx.Iv, 16);
+    AES_ctx ctx;
 
     Swap16(key_rev, key);
     Swap16(iv_rev, iv);
-    AES_init_ctx_iv(&Ctx, key_rev, iv_rev);
-
-    for (u32 i = 0; i < len; i += 16)
-    {
-        Swap16(data_rev, &data[i]);
-        AES_CTR_xcrypt_buffer(&Ctx, data_rev, 16);
-        Swap16(&data[i], data_rev);
-    }
+    AES_init_ctx_iv(&ctx, key_rev, iv_rev);
 
-    memcpy(Ctx.RoundKey, &oldkeys[16*0], 16);
-    memcpy(Ctx.Iv, &oldkeys[16*1], 16);
+    Crypt_CTR(&ctx, data, (len + 15) >> 4, true);
 }
 
 }
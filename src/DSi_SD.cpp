@@ -146,6 +146,23 @@ void DSi_SDHost::Reset()
     if (Ports[1]) Ports[1]->Reset();
 }
 
+void DSi_SDHost::FlushStorage()
+{
+    // only the SD/MMC host has storage devices attached
+    if (Num != 0) return;
+
+    if (Ports[0]) ((DSi_MMCStorage*)Ports[0])->Flush();
+    if (Ports[1]) ((DSi_MMCStorage*)Ports[1])->Flush();
+}
+
+bool DSi_SDHost::GetStorageStats(u32 port, u64* blocksread, u64* blockswritten, u64* filereads, u64* filewrites)
+{
+    if (Num != 0 || port > 1 || !Ports[port]) return false;
+
+    ((DSi_MMCStorage*)Ports[port])->GetStats(blocksread, blockswritten, filereads, filewrites);
+    return true;
+}
+
 void DSi_SDHost::DoSavestate(Savestate* file)
 {
     // TODO!
@@ -732,13 +749,39 @@ DSi_MMCStorage::DSi_MMCStorage(DSi_SDHost* host, bool internal, const char* path
             File = Platform::OpenLocalFile(path, "w+b");
         }
     }
+
+    CacheData = new u8[kCacheNumChunks * kCacheChunkSize];
+    for (int i = 0; i < kCacheNumChunks; i++)
+    {
+        Cache[i].Addr = ~(u64)0;
+        Cache[i].DirtyMask = 0;
+        Cache[i].LastUse = 0;
+        Cache[i].Data = &CacheData[i * kCacheChunkSize];
+    }
+    CacheTick = 0;
+
+    StatBlocksRead = 0;
+    StatBlocksWritten = 0;
+    StatFileReads = 0;
+    StatFileWrites = 0;
 }
 
 DSi_MMCStorage::~DSi_MMCStorage()
 {
+    Flush();
+
+    delete[] CacheData;
     if (File) fclose(File);
 }
 
+void DSi_MMCStorage::GetStats(u64* blocksread, u64* blockswritten, u64* filereads, u64* filewrites)
+{
+    *blocksread = StatBlocksRead;
+    *blockswritten = StatBlocksWritten;
+    *filereads = StatFileReads;
+    *filewrites = StatFileWrites;
+}
+
 void DSi_MMCStorage::Reset()
 {
     // TODO: reset file access????
@@ -818,7 +861,7 @@ void DSi_MMCStorage::SendCMD(u8 cmd, u32 param)
 
     case 12: // stop operation
         SetState(0x04);
-        if (File) fflush(File);
+        Flush();
         RWCommand = 0;
         Host->SendResponse(CSR, true);
         return;
@@ -854,6 +897,19 @@ void DSi_MMCStorage::SendCMD(u8 cmd, u32 param)
         SetState(0x05);
         return;
 
+    case 24: // write single block
+        RWAddress = param;
+        if (OCR & (1<<30))
+        {
+            RWAddress <<= 9;
+            BlockSize = 512;
+        }
+        RWCommand = 24;
+        Host->SendResponse(CSR, true);
+        SetState(0x04);
+        ContinueTransfer();
+        return;
+
     case 25: // write multiple blocks
         //printf("WRITE_MULTIPLE_BLOCKS addr=%08X size=%08X\n", param, BlockSize);
         RWAddress = param;
@@ -929,6 +985,16 @@ void DSi_MMCStorage::ContinueTransfer()
         len = ReadBlock(RWAddress);
         break;
 
+    case 24:
+        len = WriteBlock(RWAddress);
+        if (len)
+        {
+            // no CMD12 follows a single block write
+            RWCommand = 0;
+            Flush();
+        }
+        break;
+
     case 25:
         len = WriteBlock(RWAddress);
         break;
@@ -937,17 +1003,126 @@ void DSi_MMCStorage::ContinueTransfer()
     RWAddress += len;
 }
 
-u32 DSi_MMCStorage::ReadBlock(u64 addr)
+DSi_MMCStorage::CacheChunk* DSi_MMCStorage::GetCacheChunk(u64 addr)
 {
-    u32 len = BlockSize;
-    len = Host->GetTransferrableLen(len);
+    CacheTick++;
 
-    u8 data[0x200];
+    CacheChunk* victim = &Cache[0];
+    for (int i = 0; i < kCacheNumChunks; i++)
+    {
+        CacheChunk* chunk = &Cache[i];
+        if (chunk->Addr == addr)
+        {
+            chunk->LastUse = CacheTick;
+            return chunk;
+        }
+
+        if (chunk->LastUse < victim->LastUse)
+            victim = chunk;
+    }
+
+    WriteBackChunk(victim);
+
+    victim->Addr = addr;
+    victim->DirtyMask = 0;
+    victim->LastUse = CacheTick;
+
+    // past the end of the file (ie. fresh SD image), read as zeroes
+    u32 len = 0;
     if (File)
     {
         fseek(File, addr, SEEK_SET);
-        fread(data, 1, len, File);
+        len = fread(victim->Data, 1, kCacheChunkSize, File);
+        StatFileReads++;
     }
+    if (len < kCacheChunkSize)
+        memset(&victim->Data[len], 0, kCacheChunkSize - len);
+
+    return victim;
+}
+
+void DSi_MMCStorage::WriteBackChunk(CacheChunk* chunk)
+{
+    if (!chunk->DirtyMask) return;
+
+    if (File)
+    {
+        // write contiguous runs of dirty blocks in one go
+        for (u32 i = 0; i < 64; )
+        {
+            if (!(chunk->DirtyMask & (1ULL << i)))
+            {
+                i++;
+                continue;
+            }
+
+            u32 j = i;
+            while (j < 64 && (chunk->DirtyMask & (1ULL << j))) j++;
+
+            fseek(File, chunk->Addr + (i << 9), SEEK_SET);
+            fwrite(&chunk->Data[i << 9], 1, (j - i) << 9, File);
+            StatFileWrites++;
+
+            i = j;
+        }
+    }
+
+    chunk->DirtyMask = 0;
+}
+
+void DSi_MMCStorage::Flush()
+{
+    for (int i = 0; i < kCacheNumChunks; i++)
+        WriteBackChunk(&Cache[i]);
+
+    if (File) fflush(File);
+}
+
+void DSi_MMCStorage::ReadData(u64 addr, u8* data, u32 len)
+{
+    while (len > 0)
+    {
+        u32 offset = addr & (kCacheChunkSize-1);
+        u32 chunklen = kCacheChunkSize - offset;
+        if (chunklen > len) chunklen = len;
+
+        CacheChunk* chunk = GetCacheChunk(addr - offset);
+        memcpy(data, &chunk->Data[offset], chunklen);
+
+        addr += chunklen;
+        data += chunklen;
+        len -= chunklen;
+    }
+}
+
+void DSi_MMCStorage::WriteData(u64 addr, u8* data, u32 len)
+{
+    while (len > 0)
+    {
+        u32 offset = addr & (kCacheChunkSize-1);
+        u32 chunklen = kCacheChunkSize - offset;
+        if (chunklen > len) chunklen = len;
+
+        CacheChunk* chunk = GetCacheChunk(addr - offset);
+        memcpy(&chunk->Data[offset], data, chunklen);
+
+        for (u32 i = offset >> 9; i <= ((offset + chunklen - 1) >> 9); i++)
+            chunk->DirtyMask |= (1ULL << i);
+
+        addr += chunklen;
+        data += chunklen;
+        len -= chunklen;
+    }
+}
+
+u32 DSi_MMCStorage::ReadBlock(u64 addr)
+{
+    u32 len = BlockSize;
+    len = Host->GetTransferrableLen(len);
+
+    u8 data[0x200];
+    ReadData(addr, data, len);
+    StatBlocksRead++;
 
     return Host->DataRX(data, len);
 }
@@ -960,11 +1135,8 @@ u32 DSi_MMCStorage::WriteBlock(u64 addr)
     u8 data[0x200];
     if (len = Host->DataTX(data, len))
     {
-        if (File)
-        {
-            fseek(File, addr, SEEK_SET);
-            fwrite(data, 1, len, File);
-        }
+        WriteData(addr, data, len);
+        StatBlocksWritten++;
     }
 
     return len;
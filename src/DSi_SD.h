@@ -37,6 +37,12 @@ public:
 
     void Reset();
 
+    // writes back the cached blocks of the attached SD card and NAND
+    void FlushStorage();
+    // I/O counters of the storage on the given port (0=SD card 1=NAND)
+    // returns false if there is none
+    bool GetStorageStats(u32 port, u64* blocksread, u64* blockswritten, u64* filereads, u64* filewrites);
+
     void DoSavestate(Savestate* file);
 
     static void FinishRX(u32 param);
@@ -106,7 +112,7 @@ class DSi_SDDevice
 {
 public:
     DSi_SDDevice(DSi_SDHost* host) { Host = host; IRQ = false; }
-    ~DSi_SDDevice() {}
+    virtual ~DSi_SDDevice() {}
 
     virtual void Reset() = 0;
 
@@ -135,11 +141,40 @@ public:
 
     void ContinueTransfer();
 
+    // writes back the blocks held in the cache
+    void Flush();
+
+    // blocks transferred over the bus and file accesses they caused, since creation
+    void GetStats(u64* blocksread, u64* blockswritten, u64* filereads, u64* filewrites);
+
 private:
     bool Internal;
     char FilePath[1024];
     FILE* File;
 
+    // write-back cache of the image file, in chunks of 64 blocks
+    // multi-block transfers are served from a chunk that was read in one go,
+    // and written blocks only go to the file on CMD12, the end of a single
+    // block write, or eviction
+    struct CacheChunk
+    {
+        u64 Addr; // file offset, ~0 if unused
+        u64 DirtyMask; // one bit per 512-byte block
+        u32 LastUse;
+        u8* Data;
+    };
+
+    static const u32 kCacheChunkSize = 0x8000;
+    static const int kCacheNumChunks = 32;
+
+    CacheChunk Cache[kCacheNumChunks];
+    u8* CacheData;
+    u32 CacheTick;
+
+    // I/O stats
+    u64 StatBlocksRead, StatBlocksWritten;
+    u64 StatFileReads, StatFileWrites;
+
     u8 CID[16];
     u8 CSD[16];
 
@@ -155,6 +190,11 @@ private:
 
     void SetState(u32 state) { CSR &= ~(0xF << 9); CSR |= (state << 9); }
 
+    CacheChunk* GetCacheChunk(u64 addr);
+    void WriteBackChunk(CacheChunk* chunk);
+    void ReadData(u64 addr, u8* data, u32 len);
+    void WriteData(u64 addr, u8* data, u32 len);
+
     u32 ReadBlock(u64 addr);
     u32 WriteBlock(u64 addr);
 };
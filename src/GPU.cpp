@@ -52,6 +52,8 @@ u8 VRAM_I[ 16*1024];
 u8* VRAM[9]     = {VRAM_A,  VRAM_B,  VRAM_C,  VRAM_D,  VRAM_E, VRAM_F, VRAM_G, VRAM_H, VRAM_I};
 u32 VRAMMask[9] = {0x1FFFF, 0x1FFFF, 0x1FFFF, 0x1FFFF, 0xFFFF, 0x3FFF, 0x3FFF, 0x7FFF, 0x3FFF};
 
+u64 VRAMDirty[9][2];
+
 u8 VRAMCNT[9];
 u8 VRAMSTAT;
 
@@ -136,6 +138,7 @@ void Reset()
     memset(VRAM_G, 0,  16*1024);
     memset(VRAM_H, 0,  32*1024);
     memset(VRAM_I, 0,  16*1024);
+    SetAllVRAMDirty();
 
     memset(VRAMCNT, 0, 9);
     VRAMSTAT = 0;
@@ -248,6 +251,8 @@ void DoSavestate(Savestate* file)
 
     if (!file->Saving)
     {
+        SetAllVRAMDirty();
+
         for (int i = 0; i < 0x20; i++)
             VRAMPtr_ABG[i] = GetUniqueBankPtr(VRAMMap_ABG[i], i << 14);
         for (int i = 0; i < 0x10; i++)
@@ -418,6 +423,11 @@ void SetRenderSettings(int renderer, RenderSettings& settings)
 // when reading: values are read from each bank and ORed together
 // when writing: value is written to each bank
 
+void SetAllVRAMDirty()
+{
+    memset(VRAMDirty, 0xFF, sizeof(VRAMDirty));
+}
+
 u8* GetUniqueBankPtr(u32 mask, u32 offset)
 {
     if (!mask) return NULL;
@@ -47,6 +47,10 @@ extern u8 VRAM_I[ 16*1024];
 
 extern u8* VRAM[9];
 
+// one bit per 1K page of each bank, set whenever the page is written to
+// this lets the 3D renderer only upload texture data that changed
+extern u64 VRAMDirty[9][2];
+
 extern u32 VRAMMap_LCDC;
 extern u32 VRAMMap_ABG[0x20];
 extern u32 VRAMMap_AOBJ[0x10];
@@ -77,6 +81,7 @@ extern int Renderer;
 typedef struct
 {
     bool Soft_Threaded;
+    int Soft_ThreadCount; // number of screen bands rendered in parallel (1 = no band workers)
 
     int GL_ScaleFactor;
     bool GL_BetterPolygons;
@@ -100,6 +105,20 @@ void SetRenderSettings(int renderer, RenderSettings& settings);
 
 u8* GetUniqueBankPtr(u32 mask, u32 offset);
 
+void SetAllVRAMDirty();
+
+inline void SetVRAMDirty(u32 bank, u32 addr)
+{
+    VRAMDirty[bank][(addr >> 16) & 0x1] |= (u64)1 << ((addr >> 10) & 0x3F);
+}
+
+template<typename T>
+inline void WriteVRAMBank(u32 bank, u32 addr, T val)
+{
+    *(T*)&VRAM[bank][addr] = val;
+    SetVRAMDirty(bank, addr);
+}
+
 void MapVRAM_AB(u32 bank, u8 cnt);
 void MapVRAM_CD(u32 bank, u8 cnt);
 void MapVRAM_E(u32 bank, u8 cnt);
@@ -233,7 +252,7 @@ void WriteVRAM_LCDC(u32 addr, T val)
     default: return;
     }
 
-    if (VRAMMap_LCDC & (1<<bank)) *(T*)&VRAM[bank][addr] = val;
+    if (VRAMMap_LCDC & (1<<bank)) WriteVRAMBank<T>(bank, addr, val);
 }
 
 
@@ -262,13 +281,13 @@ void WriteVRAM_ABG(u32 addr, T val)
 {
     u32 mask = VRAMMap_ABG[(addr >> 14) & 0x1F];
 
-    if (mask & (1<<0)) *(T*)&VRAM_A[addr & 0x1FFFF] = val;
-    if (mask & (1<<1)) *(T*)&VRAM_B[addr & 0x1FFFF] = val;
-    if (mask & (1<<2)) *(T*)&VRAM_C[addr & 0x1FFFF] = val;
-    if (mask & (1<<3)) *(T*)&VRAM_D[addr & 0x1FFFF] = val;
-    if (mask & (1<<4)) *(T*)&VRAM_E[addr & 0xFFFF] = val;
-    if (mask & (1<<5)) *(T*)&VRAM_F[addr & 0x3FFF] = val;
-    if (mask & (1<<6)) *(T*)&VRAM_G[addr & 0x3FFF] = val;
+    if (mask & (1<<0)) WriteVRAMBank<T>(0, addr & 0x1FFFF, val);
+    if (mask & (1<<1)) WriteVRAMBank<T>(1, addr & 0x1FFFF, val);
+    if (mask & (1<<2)) WriteVRAMBank<T>(2, addr & 0x1FFFF, val);
+    if (mask & (1<<3)) WriteVRAMBank<T>(3, addr & 0x1FFFF, val);
+    if (mask & (1<<4)) WriteVRAMBank<T>(4, addr & 0xFFFF, val);
+    if (mask & (1<<5)) WriteVRAMBank<T>(5, addr & 0x3FFF, val);
+    if (mask & (1<<6)) WriteVRAMBank<T>(6, addr & 0x3FFF, val);
 }
 
 
@@ -295,11 +314,11 @@ void WriteVRAM_AOBJ(u32 addr, T val)
 {
     u32 mask = VRAMMap_AOBJ[(addr >> 14) & 0xF];
 
-    if (mask & (1<<0)) *(T*)&VRAM_A[addr & 0x1FFFF] = val;
-    if (mask & (1<<1)) *(T*)&VRAM_B[addr & 0x1FFFF] = val;
-    if (mask & (1<<4)) *(T*)&VRAM_E[addr & 0xFFFF] = val;
-    if (mask & (1<<5)) *(T*)&VRAM_F[addr & 0x3FFF] = val;
-    if (mask & (1<<6)) *(T*)&VRAM_G[addr & 0x3FFF] = val;
+    if (mask & (1<<0)) WriteVRAMBank<T>(0, addr & 0x1FFFF, val);
+    if (mask & (1<<1)) WriteVRAMBank<T>(1, addr & 0x1FFFF, val);
+    if (mask & (1<<4)) WriteVRAMBank<T>(4, addr & 0xFFFF, val);
+    if (mask & (1<<5)) WriteVRAMBank<T>(5, addr & 0x3FFF, val);
+    if (mask & (1<<6)) WriteVRAMBank<T>(6, addr & 0x3FFF, val);
 }
 
 
@@ -324,9 +343,9 @@ void WriteVRAM_BBG(u32 addr, T val)
 {
     u32 mask = VRAMMap_BBG[(addr >> 14) & 0x7];
 
-    if (mask & (1<<2)) *(T*)&VRAM_C[addr & 0x1FFFF] = val;
-    if (mask & (1<<7)) *(T*)&VRAM_H[addr & 0x7FFF] = val;
-    if (mask & (1<<8)) *(T*)&VRAM_I[addr & 0x3FFF] = val;
+    if (mask & (1<<2)) WriteVRAMBank<T>(2, addr & 0x1FFFF, val);
+    if (mask & (1<<7)) WriteVRAMBank<T>(7, addr & 0x7FFF, val);
+    if (mask & (1<<8)) WriteVRAMBank<T>(8, addr & 0x3FFF, val);
 }
 
 
@@ -350,8 +369,8 @@ void WriteVRAM_BOBJ(u32 addr, T val)
 {
     u32 mask = VRAMMap_BOBJ[(addr >> 14) & 0x7];
 
-    if (mask & (1<<3)) *(T*)&VRAM_D[addr & 0x1FFFF] = val;
-    if (mask & (1<<8)) *(T*)&VRAM_I[addr & 0x3FFF] = val;
+    if (mask & (1<<3)) WriteVRAMBank<T>(3, addr & 0x1FFFF, val);
+    if (mask & (1<<8)) WriteVRAMBank<T>(8, addr & 0x3FFF, val);
 }
 
 
@@ -372,8 +391,8 @@ void WriteVRAM_ARM7(u32 addr, T val)
 {
     u32 mask = VRAMMap_ARM7[(addr >> 17) & 0x1];
 
-    if (mask & (1<<2)) *(T*)&VRAM_C[addr & 0x1FFFF] = val;
-    if (mask & (1<<3)) *(T*)&VRAM_D[addr & 0x1FFFF] = val;
+    if (mask & (1<<2)) WriteVRAMBank<T>(2, addr & 0x1FFFF, val);
+    if (mask & (1<<3)) WriteVRAMBank<T>(3, addr & 0x1FFFF, val);
 }
 
 
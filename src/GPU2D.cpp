@@ -1065,6 +1065,10 @@ void GPU2D::DoCapture(u32 line, u32 width)
     dstaddr &= 0xFFFF;
     srcBaddr &= 0xFFFF;
 
+    // a captured line is at most 512 bytes, so it spans at most two pages
+    GPU::SetVRAMDirty(dstvram, dstaddr << 1);
+    GPU::SetVRAMDirty(dstvram, ((dstaddr + width - 1) & 0xFFFF) << 1);
+
     switch ((CaptureCnt >> 29) & 0x3)
     {
     case 0: // source A
@@ -112,6 +112,11 @@ u16 IndexBuffer[2048 * 40];
 GLuint TexMemID;
 GLuint TexPalMemID;
 
+// VRAM banks last uploaded to each texture and palette slot
+// a slot is fully reuploaded when its mapping changes, otherwise only the dirty rows
+u32 TexSlotMap[4];
+u32 TexPalSlotMap[6];
+
 int ScaleFactor;
 bool BetterPolygons;
 int ScreenW, ScreenH;
@@ -369,6 +374,9 @@ bool Init()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5_A1, 1024, 48, 0, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, NULL);
 
+    memset(TexSlotMap, 0xFF, sizeof(TexSlotMap));
+    memset(TexPalSlotMap, 0xFF, sizeof(TexPalSlotMap));
+
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     return true;
@@ -398,6 +406,8 @@ void DeInit()
 
 void Reset()
 {
+    memset(TexSlotMap, 0xFF, sizeof(TexSlotMap));
+    memset(TexPalSlotMap, 0xFF, sizeof(TexPalSlotMap));
 }
 
 void SetRenderSettings(GPU::RenderSettings& settings)
@@ -1156,6 +1166,94 @@ void RenderSceneChunk(int y, int h)
 }
 
 
+bool IsVRAMPageDirty(u32 bank, u32 page)
+{
+    return GPU::VRAMDirty[bank][page >> 6] & ((u64)1 << (page & 0x3F));
+}
+
+void UploadTextures()
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, TexMemID);
+    for (int i = 0; i < 4; i++)
+    {
+        // 4 x 128K chunks, one row is one 1K page
+        u32 mask = GPU::VRAMMap_Texture[i];
+        u32 bank;
+        bool full = (mask != TexSlotMap[i]);
+        TexSlotMap[i] = mask;
+        if (!mask) continue;
+        else if (mask & (1<<0)) bank = 0;
+        else if (mask & (1<<1)) bank = 1;
+        else if (mask & (1<<2)) bank = 2;
+        else if (mask & (1<<3)) bank = 3;
+
+        u8* vram = GPU::VRAM[bank];
+        if (full)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*128, 1024, 128, GL_RED_INTEGER, GL_UNSIGNED_BYTE, vram);
+            continue;
+        }
+
+        for (u32 row = 0; row < 128;)
+        {
+            if (!IsVRAMPageDirty(bank, row))
+            {
+                row++;
+                continue;
+            }
+
+            u32 start = row;
+            while (row < 128 && IsVRAMPageDirty(bank, row))
+                row++;
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*128 + start, 1024, row - start, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &vram[start * 1024]);
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, TexPalMemID);
+    for (int i = 0; i < 6; i++)
+    {
+        // 6 x 16K chunks, one row is two 1K pages
+        u32 mask = GPU::VRAMMap_TexPal[i];
+        u32 bank, offset;
+        bool full = (mask != TexPalSlotMap[i]);
+        TexPalSlotMap[i] = mask;
+        if (!mask) continue;
+        else if (mask & (1<<4)) { bank = 4; offset = (i&3)*0x4000; }
+        else if (mask & (1<<5)) { bank = 5; offset = 0; }
+        else if (mask & (1<<6)) { bank = 6; offset = 0; }
+
+        u8* vram = &GPU::VRAM[bank][offset];
+        if (full)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*8, 1024, 8, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, vram);
+            continue;
+        }
+
+        u32 page = offset >> 10;
+        for (u32 row = 0; row < 8;)
+        {
+            if (!IsVRAMPageDirty(bank, page + row*2) && !IsVRAMPageDirty(bank, page + row*2 + 1))
+            {
+                row++;
+                continue;
+            }
+
+            u32 start = row;
+            while (row < 8 && (IsVRAMPageDirty(bank, page + row*2) || IsVRAMPageDirty(bank, page + row*2 + 1)))
+                row++;
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*8 + start, 1024, row - start, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, &vram[start * 2048]);
+        }
+    }
+
+    // banks that aren't mapped to a slot anymore get fully uploaded once they are
+    // mapped again, so all the texture banks (A-G) can be marked clean here
+    memset(GPU::VRAMDirty, 0, 7 * sizeof(GPU::VRAMDirty[0]));
+}
+
 void RenderFrame()
 {
     CurShaderID = -1;
@@ -1218,37 +1316,7 @@ void RenderFrame()
     if (unibuf) memcpy(unibuf, &ShaderConfig, sizeof(ShaderConfig));
     glUnmapBuffer(GL_UNIFORM_BUFFER);
 
-    // SUCKY!!!!!!!!!!!!!!!!!!
-    // TODO: detect when VRAM blocks are modified!
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, TexMemID);
-    for (int i = 0; i < 4; i++)
-    {
-        u32 mask = GPU::VRAMMap_Texture[i];
-        u8* vram;
-        if (!mask) continue;
-        else if (mask & (1<<0)) vram = GPU::VRAM_A;
-        else if (mask & (1<<1)) vram = GPU::VRAM_B;
-        else if (mask & (1<<2)) vram = GPU::VRAM_C;
-        else if (mask & (1<<3)) vram = GPU::VRAM_D;
-
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*128, 1024, 128, GL_RED_INTEGER, GL_UNSIGNED_BYTE, vram);
-    }
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, TexPalMemID);
-    for (int i = 0; i < 6; i++)
-    {
-        // 6 x 16K chunks
-        u32 mask = GPU::VRAMMap_TexPal[i];
-        u8* vram;
-        if (!mask) continue;
-        else if (mask & (1<<4)) vram = &GPU::VRAM_E[(i&3)*0x4000];
-        else if (mask & (1<<5)) vram = GPU::VRAM_F;
-        else if (mask & (1<<6)) vram = GPU::VRAM_G;
-
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i*8, 1024, 8, GL_RGBA, GL_UNSIGNED_SHORT_1_5_5_5_REV, vram);
-    }
+    UploadTextures();
 
     glDisable(GL_SCISSOR_TEST);
     glEnable(GL_DEPTH_TEST);
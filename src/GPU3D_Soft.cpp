@@ -18,6 +18,13 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unordered_map>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "NDS.h"
 #include "GPU.h"
 #include "Config.h"
@@ -70,6 +77,28 @@ void* Sema_ScanlineCount;
 
 void RenderThreadFunc();
 
+// band rendering
+// the screen is split in horizontal bands that are rendered in parallel
+// band 0 is rendered by whoever calls RenderPolygons(), the others by
+// their own worker thread
+
+const int MaxRenderBands = 8;
+
+int NumBands;
+int NewNumBands;
+bool BandThreadsRunning;
+void* BandThread[MaxRenderBands];
+int BandThreadNextID;
+void* Sema_BandThreadInit;
+void* Sema_BandStart[MaxRenderBands];
+void* Sema_BandDone[MaxRenderBands];
+void* Sema_BandFirstLine[MaxRenderBands];
+void* Sema_BandLastPass[MaxRenderBands];
+
+void StopBandThreads();
+
+void ResetTexCache();
+
 
 void StopRenderThread()
 {
@@ -113,20 +142,47 @@ bool Init()
     Sema_RenderDone = Platform::Semaphore_Create();
     Sema_ScanlineCount = Platform::Semaphore_Create();
 
+    Sema_BandThreadInit = Platform::Semaphore_Create();
+    for (int i = 0; i < MaxRenderBands; i++)
+    {
+        Sema_BandStart[i] = Platform::Semaphore_Create();
+        Sema_BandDone[i] = Platform::Semaphore_Create();
+        Sema_BandFirstLine[i] = Platform::Semaphore_Create();
+        Sema_BandLastPass[i] = Platform::Semaphore_Create();
+    }
+
     Threaded = false;
     RenderThreadRunning = false;
     RenderThreadRendering = false;
 
+    NumBands = 1;
+    NewNumBands = 1;
+    BandThreadsRunning = false;
+
+    ResetTexCache();
+
     return true;
 }
 
 void DeInit()
 {
     StopRenderThread();
+    StopBandThreads();
 
     Platform::Semaphore_Free(Sema_RenderStart);
     Platform::Semaphore_Free(Sema_RenderDone);
     Platform::Semaphore_Free(Sema_ScanlineCount);
+
+    Platform::Semaphore_Free(Sema_BandThreadInit);
+    for (int i = 0; i < MaxRenderBands; i++)
+    {
+        Platform::Semaphore_Free(Sema_BandStart[i]);
+        Platform::Semaphore_Free(Sema_BandDone[i]);
+        Platform::Semaphore_Free(Sema_BandFirstLine[i]);
+        Platform::Semaphore_Free(Sema_BandLastPass[i]);
+    }
+
+    ResetTexCache();
 }
 
 void Reset()
@@ -143,11 +199,33 @@ void Reset()
 void SetRenderSettings(GPU::RenderSettings& settings)
 {
     Threaded = settings.Soft_Threaded;
+
+    // the band workers are (re)started by the rendering thread itself,
+    // at the start of the next frame
+    NewNumBands = settings.Soft_ThreadCount;
+    if (NewNumBands < 1) NewNumBands = 1;
+    else if (NewNumBands > MaxRenderBands) NewNumBands = MaxRenderBands;
+
     SetupRenderThread();
 }
 
 
 
+// pixels are processed in spans of SpanLength along X: perspective factors, depth tests
+// and attribute interpolation are done for the whole span at once.
+// with GCC/Clang, vector extensions lower these to whatever SIMD the target has.
+
+const int SpanLength = 8;
+
+#if defined(__GNUC__)
+typedef s32 s32xSpan __attribute__((vector_size(SpanLength * 4)));
+typedef u32 u32xSpan __attribute__((vector_size(SpanLength * 4)));
+typedef s64 s64xSpan __attribute__((vector_size(SpanLength * 8)));
+
+const s32xSpan SpanLane = {0, 1, 2, 3, 4, 5, 6, 7};
+#endif
+
+
 // Notes on the interpolator:
 //
 // This is a theory on how the DS hardware interpolates values. It matches hardware output
@@ -190,6 +268,8 @@ public:
             this->xrecip = 0;
         this->xrecip_z = this->xrecip >> 8;
 
+        this->spanx = -0x10000;
+
         // linear mode is used if both W values are equal and have
         // low-order bits cleared (0-6 along X, 1-6 along Y)
         u32 mask = dir ? 0x7E : 0x7F;
@@ -235,14 +315,173 @@ public:
         this->x = x;
         if (xdiff != 0 && !linear)
         {
-            s64 num = ((s64)x * w0n) << shift;
-            s32 den = (x * w0d) + ((xdiff-x) * w1d);
+            if (dir == 0)
+            {
+                // along X, the factors are calculated for a whole span of pixels at once
+                if ((u32)(x - spanx) >= SpanLength)
+                    CalcSpanFactors(x);
+
+                yfactor = spanfactor[x - spanx];
+            }
+            else
+            {
+                s64 num = ((s64)x * w0n) << shift;
+                s32 den = (x * w0d) + ((xdiff-x) * w1d);
+
+                // this seems to be a proper division on hardware :/
+                // I haven't been able to find cases that produce imperfect output
+                if (den == 0) yfactor = 0;
+                else          yfactor = (s32)(num / den);
+            }
+        }
+    }
+
+    void CalcSpanFactors(s32 x)
+    {
+        // same division as above, done in double precision so several pixels
+        // can be divided at once. W is normalized to 16 bits, so the numerator
+        // stays well within 53 bits and the truncated quotient is exact.
+        alignas(16) double num[SpanLength];
+        alignas(16) double den[SpanLength];
+        alignas(16) double quo[SpanLength];
+
+        spanx = x;
+
+        for (int i = 0; i < SpanLength; i++, x++)
+        {
+            s32 d = (x * w0d) + ((xdiff-x) * w1d);
+            if (d == 0)
+            {
+                num[i] = 0;
+                den[i] = 1;
+            }
+            else
+            {
+                num[i] = (double)(((s64)x * w0n) << shift);
+                den[i] = (double)d;
+            }
+        }
+
+#if defined(__SSE2__)
+        for (int i = 0; i < SpanLength; i += 2)
+            _mm_store_pd(&quo[i], _mm_div_pd(_mm_load_pd(&num[i]), _mm_load_pd(&den[i])));
+#elif defined(__aarch64__)
+        for (int i = 0; i < SpanLength; i += 2)
+            vst1q_f64(&quo[i], vdivq_f64(vld1q_f64(&num[i]), vld1q_f64(&den[i])));
+#else
+        for (int i = 0; i < SpanLength; i++)
+            quo[i] = num[i] / den[i];
+#endif
+
+        for (int i = 0; i < SpanLength; i++)
+            spanfactor[i] = (s32)(s64)quo[i];
+    }
+
+    void SetSpan(s32 x)
+    {
+        // start a span of pixels at x along X, for the *Span() functions below
+        x -= x0;
+        if (xdiff != 0 && !linear)
+            CalcSpanFactors(x);
+        else
+            spanx = x;
+    }
+
+    void InterpolateSpan(s32 y0, s32 y1, s32* out)
+    {
+#if defined(__GNUC__)
+        s32xSpan res;
+
+        if (xdiff == 0 || y0 == y1)
+            res = (s32xSpan){} + y0;
+        else if (!linear)
+        {
+            u32xSpan factor;
+            memcpy(&factor, spanfactor, sizeof(factor));
+
+            if (y0 < y1)
+                res = y0 + (s32xSpan)(((u32)(y1-y0) * factor) >> shift);
+            else
+                res = y1 + (s32xSpan)(((u32)(y0-y1) * ((1<<shift)-factor)) >> shift);
+        }
+        else
+        {
+            s64xSpan xs = __builtin_convertvector(spanx + SpanLane, s64xSpan);
+
+            if (y0 < y1)
+                res = y0 + __builtin_convertvector(((((s64)(y1-y0) * xs * xrecip) + (3<<24)) >> 30), s32xSpan);
+            else
+                res = y1 + __builtin_convertvector(((((s64)(y0-y1) * (xdiff-xs) * xrecip) + (3<<24)) >> 30), s32xSpan);
+        }
+
+        memcpy(out, &res, sizeof(res));
+#else
+        for (int i = 0; i < SpanLength; i++)
+        {
+            SetX(x0 + spanx + i);
+            out[i] = Interpolate(y0, y1);
+        }
+#endif
+    }
+
+    void InterpolateZSpan(s32 z0, s32 z1, bool wbuffer, s32* out)
+    {
+#if defined(__GNUC__)
+        s32xSpan res;
+
+        if (xdiff == 0 || z0 == z1)
+            res = (s32xSpan){} + z0;
+        else if (wbuffer)
+        {
+            if (linear)
+            {
+                // the factor isn't calculated in linear mode, keep the exact scalar behavior
+                for (int i = 0; i < SpanLength; i++)
+                {
+                    SetX(x0 + spanx + i);
+                    out[i] = InterpolateZ(z0, z1, wbuffer);
+                }
+                return;
+            }
+
+            u32xSpan factor;
+            memcpy(&factor, spanfactor, sizeof(factor));
+
+            if (z0 < z1)
+                res = z0 + __builtin_convertvector(((s64)(z1-z0) * __builtin_convertvector(factor, s64xSpan)) >> shift, s32xSpan);
+            else
+                res = z1 + __builtin_convertvector(((s64)(z0-z1) * __builtin_convertvector((1<<shift)-factor, s64xSpan)) >> shift, s32xSpan);
+        }
+        else
+        {
+            s32 base, disp;
+            s32xSpan factor;
+
+            if (z0 < z1)
+            {
+                base = z0;
+                disp = z1 - z0;
+                factor = spanx + SpanLane;
+            }
+            else
+            {
+                base = z1;
+                disp = z0 - z1;
+                factor = xdiff - (spanx + SpanLane);
+            }
 
-            // this seems to be a proper division on hardware :/
-            // I haven't been able to find cases that produce imperfect output
-            if (den == 0) yfactor = 0;
-            else          yfactor = (s32)(num / den);
+            disp >>= 9;
+            res = base + __builtin_convertvector(((s64)disp * __builtin_convertvector(factor, s64xSpan) * xrecip_z) >> 13, s32xSpan);
+        }
+
+        memcpy(out, &res, sizeof(res));
+#else
+        for (int i = 0; i < SpanLength; i++)
+        {
+            SetX(x0 + spanx + i);
+            out[i] = InterpolateZ(z0, z1, wbuffer);
         }
+#endif
     }
 
     s32 Interpolate(s32 y0, s32 y1)
@@ -328,6 +567,9 @@ private:
     s32 w0n, w0d, w1d;
 
     u32 yfactor;
+
+    s32 spanx;
+    u32 spanfactor[SpanLength];
 };
 
 
@@ -536,10 +778,43 @@ private:
     s32 ycoverage, ycov_incr;
 };
 
-typedef struct
+// decoded texture cache
+// textures are decoded once to one u32 per texel (color in bits 0-15, alpha in
+// bits 16-20) and sampled from there. at the start of a frame, entries whose
+// VRAM was modified or remapped are dropped.
+
+struct TexCacheEntry
+{
+    s32 Width, Height;
+
+    // VRAM the texture was decoded from
+    u32 TexAddr, TexLen;     // texel data, in texture VRAM
+    u32 IndexAddr, IndexLen; // palette indices of 4x4 compressed textures, in texture VRAM
+    u32 PalAddr, PalLen;     // in texture palette VRAM
+
+    std::vector<u32> Texels;
+};
+
+// when the cache grows past this, it is cleared at the start of the next frame
+const u32 TexCacheMaxTexels = 0x400000;
+
+std::unordered_map<u64, TexCacheEntry> TexCache;
+u32 TexCacheTexels;
+
+// VRAM banks mapped to each texture/palette slot as of the last cache update
+u32 TexCacheSlotMap[4];
+u32 TexCachePalSlotMap[8];
+
+typedef struct RendererPolygon
 {
     Polygon* PolyData;
 
+    // decoded texture, for textured polygons
+    TexCacheEntry* Texture;
+
+    // scanline routine specialized for this polygon's attributes
+    void (*DrawScanline)(struct RendererPolygon* rp, s32 y);
+
     Slope<0> SlopeL;
     Slope<1> SlopeR;
     s32 XL, XR;
@@ -551,20 +826,11 @@ typedef struct
 RendererPolygon PolygonList[2048];
 
 
-void TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha)
+// texture wrapping
+// TODO: optimize this somehow
+// testing shows that it's hardly worth optimizing, actually
+inline void WrapTexCoords(u32 texparam, s32 width, s32 height, s16& s, s16& t)
 {
-    u32 vramaddr = (texparam & 0xFFFF) << 3;
-
-    s32 width = 8 << ((texparam >> 20) & 0x7);
-    s32 height = 8 << ((texparam >> 23) & 0x7);
-
-    s >>= 4;
-    t >>= 4;
-
-    // texture wrapping
-    // TODO: optimize this somehow
-    // testing shows that it's hardly worth optimizing, actually
-
     if (texparam & (1<<16))
     {
         if (texparam & (1<<18))
@@ -596,6 +862,19 @@ void TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha
         if (t < 0) t = 0;
         else if (t >= height) t = height-1;
     }
+}
+
+void TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha)
+{
+    u32 vramaddr = (texparam & 0xFFFF) << 3;
+
+    s32 width = 8 << ((texparam >> 20) & 0x7);
+    s32 height = 8 << ((texparam >> 23) & 0x7);
+
+    s >>= 4;
+    t >>= 4;
+
+    WrapTexCoords(texparam, width, height, s, t);
 
     u8 alpha0;
     if (texparam & (1<<29)) alpha0 = 0;
@@ -777,6 +1056,190 @@ void TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha
     }
 }
 
+TexCacheEntry* GetTexture(u32 texparam, u32 texpal)
+{
+    u32 fmt = (texparam >> 26) & 0x7;
+
+    // the wrapping mode doesn't affect the texel data
+    texparam &= 0x3FF0FFFF;
+    if (fmt == 7) texpal = 0;
+
+    u64 key = ((u64)texpal << 32) | texparam;
+    auto it = TexCache.find(key);
+    if (it != TexCache.end())
+        return &it->second;
+
+    TexCacheEntry& entry = TexCache[key];
+
+    s32 width = 8 << ((texparam >> 20) & 0x7);
+    s32 height = 8 << ((texparam >> 23) & 0x7);
+    u32 numtexels = width * height;
+
+    entry.Width = width;
+    entry.Height = height;
+    entry.TexAddr = (texparam & 0xFFFF) << 3;
+    entry.IndexAddr = 0;
+    entry.IndexLen = 0;
+    entry.PalAddr = texpal << 4;
+
+    switch (fmt)
+    {
+    case 1: entry.TexLen = numtexels;      entry.PalLen = 32*2; break;
+    case 2: entry.TexLen = numtexels >> 2; entry.PalLen = 4*2; entry.PalAddr = texpal << 3; break;
+    case 3: entry.TexLen = numtexels >> 1; entry.PalLen = 16*2; break;
+    case 4: entry.TexLen = numtexels;      entry.PalLen = 256*2; break;
+    case 5:
+        entry.TexLen = numtexels >> 2;
+        if ((entry.TexAddr >> 17) == ((entry.TexAddr + entry.TexLen - 1) >> 17))
+        {
+            entry.IndexAddr = 0x20000 + ((entry.TexAddr & 0x1FFFC) >> 1);
+            if (entry.TexAddr >= 0x40000)
+                entry.IndexAddr += 0x10000;
+            entry.IndexLen = entry.TexLen >> 1;
+        }
+        else
+        {
+            // texel data crossing a slot boundary, its indices wrap around
+            entry.IndexAddr = 0x20000;
+            entry.IndexLen = 0x20000;
+        }
+        // the palette offset of each block can point anywhere in the next 64K
+        entry.PalLen = 0x10000 + 8;
+        break;
+    case 6: entry.TexLen = numtexels;      entry.PalLen = 8*2; break;
+    case 7: entry.TexLen = numtexels << 1; entry.PalLen = 0; break;
+    }
+
+    entry.Texels.resize(numtexels);
+    u32* texels = entry.Texels.data();
+    for (s32 t = 0; t < height; t++)
+    {
+        for (s32 s = 0; s < width; s++)
+        {
+            u16 color; u8 alpha;
+            TextureLookup(texparam, texpal, s << 4, t << 4, &color, &alpha);
+            *texels++ = color | (alpha << 16);
+        }
+    }
+
+    TexCacheTexels += numtexels;
+    return &entry;
+}
+
+bool IsVRAMRangeDirty(u64* dirty, u32 numpages, u32 addr, u32 len)
+{
+    if (!len) return false;
+
+    u32 start = addr >> 10;
+    u32 end = (addr + len - 1) >> 10;
+    if (end - start >= numpages)
+        end = start + numpages - 1;
+
+    for (u32 i = start; i <= end; i++)
+    {
+        u32 page = i & (numpages - 1);
+        if (dirty[page >> 6] & ((u64)1 << (page & 0x3F)))
+            return true;
+    }
+
+    return false;
+}
+
+void UpdateTexCache()
+{
+    // dirty pages, as seen from the 512K of texture VRAM and 128K of palette VRAM
+    u64 texdirty[8];
+    u64 paldirty[2];
+    bool anydirty = false;
+
+    for (int i = 0; i < 4; i++)
+    {
+        u32 mask = GPU::VRAMMap_Texture[i];
+        u64 lo = 0, hi = 0;
+
+        if (mask != TexCacheSlotMap[i])
+        {
+            lo = ~(u64)0;
+            hi = ~(u64)0;
+            TexCacheSlotMap[i] = mask;
+        }
+        else
+        {
+            for (int bank = 0; bank < 4; bank++)
+            {
+                if (!(mask & (1<<bank))) continue;
+                lo |= GPU::VRAMDirty[bank][0];
+                hi |= GPU::VRAMDirty[bank][1];
+            }
+        }
+
+        texdirty[i*2] = lo;
+        texdirty[i*2 + 1] = hi;
+        if (lo | hi) anydirty = true;
+    }
+
+    paldirty[0] = 0;
+    paldirty[1] = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        u32 mask = GPU::VRAMMap_TexPal[i];
+        u64 slot = 0;
+
+        if (mask != TexCachePalSlotMap[i])
+        {
+            slot = 0xFFFF;
+            TexCachePalSlotMap[i] = mask;
+        }
+        else
+        {
+            if (mask & (1<<4)) slot |= GPU::VRAMDirty[4][0] >> ((i & 0x3) * 16);
+            if (mask & (1<<5)) slot |= GPU::VRAMDirty[5][0];
+            if (mask & (1<<6)) slot |= GPU::VRAMDirty[6][0];
+            slot &= 0xFFFF;
+        }
+
+        paldirty[i >> 2] |= slot << ((i & 0x3) * 16);
+        if (slot) anydirty = true;
+    }
+
+    // banks that aren't mapped to a slot anymore are caught by the mapping
+    // check once they are mapped again, so all of A-G can be marked clean here
+    memset(GPU::VRAMDirty, 0, 7 * sizeof(GPU::VRAMDirty[0]));
+
+    if (TexCacheTexels > TexCacheMaxTexels)
+    {
+        TexCache.clear();
+        TexCacheTexels = 0;
+        return;
+    }
+
+    if (!anydirty) return;
+
+    for (auto it = TexCache.begin(); it != TexCache.end();)
+    {
+        TexCacheEntry& entry = it->second;
+
+        if (IsVRAMRangeDirty(texdirty, 512, entry.TexAddr, entry.TexLen) ||
+            IsVRAMRangeDirty(texdirty, 512, entry.IndexAddr, entry.IndexLen) ||
+            IsVRAMRangeDirty(paldirty, 128, entry.PalAddr, entry.PalLen))
+        {
+            TexCacheTexels -= entry.Texels.size();
+            it = TexCache.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+void ResetTexCache()
+{
+    TexCache.clear();
+    TexCacheTexels = 0;
+
+    memset(TexCacheSlotMap, 0xFF, sizeof(TexCacheSlotMap));
+    memset(TexCachePalSlotMap, 0xFF, sizeof(TexCachePalSlotMap));
+}
+
 // depth test is 'less or equal' instead of 'less than' under the following conditions:
 // * when drawing a front-facing pixel over an opaque back-facing pixel
 // * when drawing wireframe edges, under certain conditions (TODO)
@@ -827,6 +1290,92 @@ bool DepthTest_LessThan_FrontFacing(s32 dstz, s32 z, u32 dstattr)
     return false;
 }
 
+enum
+{
+    DepthMode_Equal = 0,
+    DepthMode_LessThan,
+    DepthMode_LessThan_FrontFacing,
+};
+
+template<int depthmode, bool wbuffer>
+inline bool DepthTest(s32 dstz, s32 z, u32 dstattr)
+{
+    if (depthmode == DepthMode_Equal)
+        return wbuffer ? DepthTest_Equal_W(dstz, z, dstattr) : DepthTest_Equal_Z(dstz, z, dstattr);
+    else if (depthmode == DepthMode_LessThan_FrontFacing)
+        return DepthTest_LessThan_FrontFacing(dstz, z, dstattr);
+    else
+        return DepthTest_LessThan(dstz, z, dstattr);
+}
+
+template<int depthmode, bool wbuffer>
+inline void DepthTestSpan(const u32* dstz, const u32* dstattr, const s32* z, s32* pass)
+{
+#if defined(__GNUC__)
+    s32xSpan vdstz, vz, res;
+    u32xSpan vattr;
+    memcpy(&vdstz, dstz, sizeof(vdstz));
+    memcpy(&vattr, dstattr, sizeof(vattr));
+    memcpy(&vz, z, sizeof(vz));
+
+    if (depthmode == DepthMode_Equal)
+    {
+        u32xSpan diff = (u32xSpan)(vdstz - vz);
+        if (wbuffer) res = (diff + 0xFF) <= 0x1FE;
+        else         res = (diff + 0x200) <= 0x400;
+    }
+    else if (depthmode == DepthMode_LessThan_FrontFacing)
+    {
+        s32xSpan backfacing = (vattr & 0x00400010) == 0x00000010; // opaque, back facing
+        res = (backfacing & (vz <= vdstz)) | (~backfacing & (vz < vdstz));
+    }
+    else
+        res = vz < vdstz;
+
+    memcpy(pass, &res, sizeof(res));
+#else
+    for (int i = 0; i < SpanLength; i++)
+        pass[i] = DepthTest<depthmode, wbuffer>(dstz[i], z[i], dstattr[i]);
+#endif
+}
+
+// per-pixel values for a span of a polygon scanline.
+// attributes are interpolated whether or not the pixels pass the depth test,
+// which is cheaper than doing it pixel by pixel once they do.
+struct PixelSpan
+{
+    s32 X;
+
+    s32 Z[SpanLength];
+    s32 DepthPass[SpanLength]; // against the topmost pixel, not set for shadows
+
+    s32 R[SpanLength], G[SpanLength], B[SpanLength];
+    s32 S[SpanLength], T[SpanLength];
+
+    template<int depthmode, bool wbuffer, bool shadow>
+    void Setup(Interpolator<0>& interp, s32 x, u32 pixeladdr,
+               s32 zl, s32 zr,
+               s32 rl, s32 rr, s32 gl, s32 gr, s32 bl, s32 br,
+               s32 sl, s32 sr, s32 tl, s32 tr)
+    {
+        X = x;
+        interp.SetSpan(x);
+
+        interp.InterpolateZSpan(zl, zr, wbuffer, Z);
+
+        // with shadows, the stencil buffer decides which pixel is tested
+        if (!shadow)
+            DepthTestSpan<depthmode, wbuffer>(&DepthBuffer[pixeladdr], &AttrBuffer[pixeladdr], Z, DepthPass);
+
+        interp.InterpolateSpan(rl, rr, R);
+        interp.InterpolateSpan(gl, gr, G);
+        interp.InterpolateSpan(bl, br, B);
+
+        interp.InterpolateSpan(sl, sr, S);
+        interp.InterpolateSpan(tl, tr, T);
+    }
+};
+
 u32 AlphaBlend(u32 srccolor, u32 dstcolor, u32 alpha)
 {
     u32 dstalpha = dstcolor >> 24;
@@ -857,8 +1406,10 @@ u32 AlphaBlend(u32 srccolor, u32 dstcolor, u32 alpha)
     return srcR | (srcG << 8) | (srcB << 16) | (dstalpha << 24);
 }
 
-u32 RenderPixel(Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t)
+template<bool textured>
+u32 RenderPixel(RendererPolygon* rp, u8 vr, u8 vg, u8 vb, s16 s, s16 t)
 {
+    Polygon* polygon = rp->PolyData;
     u8 r, g, b, a;
 
     u32 blendmode = (polygon->Attr >> 4) & 0x3;
@@ -889,12 +1440,18 @@ u32 RenderPixel(Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t)
         }
     }
 
-    if ((RenderDispCnt & (1<<0)) && (((polygon->TexParam >> 26) & 0x7) != 0))
+    if (textured)
     {
         u8 tr, tg, tb;
 
-        u16 tcolor; u8 talpha;
-        TextureLookup(polygon->TexParam, polygon->TexPalette, s, t, &tcolor, &talpha);
+        TexCacheEntry* tex = rp->Texture;
+        s >>= 4;
+        t >>= 4;
+        WrapTexCoords(polygon->TexParam, tex->Width, tex->Height, s, t);
+
+        u32 texel = tex->Texels[(t * tex->Width) + s];
+        u16 tcolor = texel & 0xFFFF;
+        u8 talpha = texel >> 16;
 
         tr = (tcolor << 1) & 0x3E; if (tr) tr++;
         tg = (tcolor >> 4) & 0x3E; if (tg) tg++;
@@ -1058,6 +1615,39 @@ void SetupPolygonRightEdge(RendererPolygon* rp, s32 y)
                               polygon->FinalW[rp->CurVR], polygon->FinalW[rp->NextVR], y);
 }
 
+template<int depthmode, bool wbuffer>
+void RenderShadowMaskScanline(RendererPolygon* rp, s32 y);
+template<int depthmode, bool wbuffer, bool shadow, bool textured>
+void RenderPolygonScanline(RendererPolygon* rp, s32 y);
+
+// scanline routines for every combination of depth test mode, depth
+// buffering mode, shadow and texturing
+// indexed as [depthmode][wbuffer] and [depthmode][wbuffer][shadow][textured]
+
+#define SHADOWMASK_FUNCS(d) \
+    { RenderShadowMaskScanline<d, false>, RenderShadowMaskScanline<d, true> }
+
+void (*ShadowMaskScanlineFuncs[3][2])(RendererPolygon* rp, s32 y) =
+{
+    SHADOWMASK_FUNCS(DepthMode_Equal),
+    SHADOWMASK_FUNCS(DepthMode_LessThan),
+    SHADOWMASK_FUNCS(DepthMode_LessThan_FrontFacing),
+};
+
+#define POLYGON_FUNCS(d, w) \
+    {{ RenderPolygonScanline<d, w, false, false>, RenderPolygonScanline<d, w, false, true> }, \
+     { RenderPolygonScanline<d, w, true, false>,  RenderPolygonScanline<d, w, true, true> }}
+
+void (*PolygonScanlineFuncs[3][2][2][2])(RendererPolygon* rp, s32 y) =
+{
+    { POLYGON_FUNCS(DepthMode_Equal, false), POLYGON_FUNCS(DepthMode_Equal, true) },
+    { POLYGON_FUNCS(DepthMode_LessThan, false), POLYGON_FUNCS(DepthMode_LessThan, true) },
+    { POLYGON_FUNCS(DepthMode_LessThan_FrontFacing, false), POLYGON_FUNCS(DepthMode_LessThan_FrontFacing, true) },
+};
+
+#undef SHADOWMASK_FUNCS
+#undef POLYGON_FUNCS
+
 void SetupPolygon(RendererPolygon* rp, Polygon* polygon)
 {
     u32 nverts = polygon->NumVertices;
@@ -1067,6 +1657,33 @@ void SetupPolygon(RendererPolygon* rp, Polygon* polygon)
 
     rp->PolyData = polygon;
 
+    // pick the scanline routine. these attributes don't change during the
+    // frame, so the per-pixel checks on them are resolved at compile time
+    int depthmode;
+    if (polygon->Attr & (1<<14))
+        depthmode = DepthMode_Equal;
+    else if (polygon->FacingView)
+        depthmode = DepthMode_LessThan_FrontFacing;
+    else
+        depthmode = DepthMode_LessThan;
+
+    int wbuffer = polygon->WBuffer ? 1 : 0;
+
+    if (polygon->IsShadowMask)
+    {
+        rp->DrawScanline = ShadowMaskScanlineFuncs[depthmode][wbuffer];
+    }
+    else
+    {
+        int shadow = polygon->IsShadow ? 1 : 0;
+        int textured = ((RenderDispCnt & (1<<0)) && (((polygon->TexParam >> 26) & 0x7) != 0)) ? 1 : 0;
+
+        rp->DrawScanline = PolygonScanlineFuncs[depthmode][wbuffer][shadow][textured];
+
+        if (textured)
+            rp->Texture = GetTexture(polygon->TexParam, polygon->TexPalette);
+    }
+
     rp->CurVL = vtop;
     rp->CurVR = vtop;
 
@@ -1111,6 +1728,7 @@ void SetupPolygon(RendererPolygon* rp, Polygon* polygon)
     }
 }
 
+template<int depthmode, bool wbuffer>
 void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
@@ -1121,14 +1739,6 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     u32 polyalpha = (polygon->Attr >> 16) & 0x1F;
     bool wireframe = (polyalpha == 0);
 
-    bool (*fnDepthTest)(s32 dstz, s32 z, u32 dstattr);
-    if (polygon->Attr & (1<<14))
-        fnDepthTest = polygon->WBuffer ? DepthTest_Equal_W : DepthTest_Equal_Z;
-    else if (polygon->FacingView)
-        fnDepthTest = DepthTest_LessThan_FrontFacing;
-    else
-        fnDepthTest = DepthTest_LessThan;
-
     if (!PrevIsShadowMask)
         memset(&StencilBuffer[256 * (y&0x1)], 0, 256);
 
@@ -1174,8 +1784,8 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     s32 wl = rp->SlopeL.Interp.Interpolate(polygon->FinalW[rp->CurVL], polygon->FinalW[rp->NextVL]);
     s32 wr = rp->SlopeR.Interp.Interpolate(polygon->FinalW[rp->CurVR], polygon->FinalW[rp->NextVR]);
 
-    s32 zl = rp->SlopeL.Interp.InterpolateZ(polygon->FinalZ[rp->CurVL], polygon->FinalZ[rp->NextVL], polygon->WBuffer);
-    s32 zr = rp->SlopeR.Interp.InterpolateZ(polygon->FinalZ[rp->CurVR], polygon->FinalZ[rp->NextVR], polygon->WBuffer);
+    s32 zl = rp->SlopeL.Interp.InterpolateZ(polygon->FinalZ[rp->CurVL], polygon->FinalZ[rp->NextVL], wbuffer);
+    s32 zr = rp->SlopeR.Interp.InterpolateZ(polygon->FinalZ[rp->CurVR], polygon->FinalZ[rp->NextVR], wbuffer);
 
     // if the left and right edges are swapped, render backwards.
     if (xstart > xend)
@@ -1247,20 +1857,20 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
 
         interpX.SetX(x);
 
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpX.InterpolateZ(zl, zr, wbuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
 
         // checkme
         if (!l_filledge)
             continue;
 
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
             StencilBuffer[256*(y&0x1) + x] |= 0x1;
 
         if (dstattr & 0x3)
         {
             pixeladdr += BufferSize;
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
                 StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
@@ -1277,16 +1887,16 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
 
         interpX.SetX(x);
 
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpX.InterpolateZ(zl, zr, wbuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
 
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
             StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0x3)
         {
             pixeladdr += BufferSize;
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
                 StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
@@ -1302,20 +1912,20 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
 
         interpX.SetX(x);
 
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = interpX.InterpolateZ(zl, zr, wbuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
 
         // checkme
         if (!r_filledge)
             continue;
 
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
             StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0x3)
         {
             pixeladdr += BufferSize;
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
                 StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
@@ -1324,6 +1934,7 @@ void RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     rp->XR = rp->SlopeR.Step();
 }
 
+template<int depthmode, bool wbuffer, bool shadow, bool textured>
 void RenderPolygonScanline(RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
@@ -1334,15 +1945,8 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
     u32 polyalpha = (polygon->Attr >> 16) & 0x1F;
     bool wireframe = (polyalpha == 0);
 
-    bool (*fnDepthTest)(s32 dstz, s32 z, u32 dstattr);
-    if (polygon->Attr & (1<<14))
-        fnDepthTest = polygon->WBuffer ? DepthTest_Equal_W : DepthTest_Equal_Z;
-    else if (polygon->FacingView)
-        fnDepthTest = DepthTest_LessThan_FrontFacing;
-    else
-        fnDepthTest = DepthTest_LessThan;
-
-    PrevIsShadowMask = false;
+    // only written when needed, as bands may be rendering polygons concurrently
+    if (PrevIsShadowMask) PrevIsShadowMask = false;
 
     if (polygon->YTop != polygon->YBottom)
     {
@@ -1389,8 +1993,8 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
     s32 wl = rp->SlopeL.Interp.Interpolate(polygon->FinalW[rp->CurVL], polygon->FinalW[rp->NextVL]);
     s32 wr = rp->SlopeR.Interp.Interpolate(polygon->FinalW[rp->CurVR], polygon->FinalW[rp->NextVR]);
 
-    s32 zl = rp->SlopeL.Interp.InterpolateZ(polygon->FinalZ[rp->CurVL], polygon->FinalZ[rp->NextVL], polygon->WBuffer);
-    s32 zr = rp->SlopeR.Interp.InterpolateZ(polygon->FinalZ[rp->CurVR], polygon->FinalZ[rp->NextVR], polygon->WBuffer);
+    s32 zl = rp->SlopeL.Interp.InterpolateZ(polygon->FinalZ[rp->CurVL], polygon->FinalZ[rp->NextVL], wbuffer);
+    s32 zr = rp->SlopeR.Interp.InterpolateZ(polygon->FinalZ[rp->CurVR], polygon->FinalZ[rp->NextVR], wbuffer);
 
     // if the left and right edges are swapped, render backwards.
     // on hardware, swapped edges seem to break edge length calculation,
@@ -1457,6 +2061,8 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
 
     s32 x = xstart;
     Interpolator<0> interpX(xstart, xend+1, wl, wr);
+    PixelSpan span;
+    span.X = -0x10000;
 
     if (x < 0) x = 0;
     s32 xlimit;
@@ -1481,8 +2087,12 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
         u32 dstattr = AttrBuffer[pixeladdr];
 
+        if ((u32)(x - span.X) >= SpanLength)
+            span.Setup<depthmode, wbuffer, shadow>(interpX, x, pixeladdr, zl, zr, rl, rr, gl, gr, bl, br, sl, sr, tl, tr);
+        int i = x - span.X;
+
         // check stencil buffer for shadows
-        if (polygon->IsShadow)
+        if (shadow)
         {
             u8 stencil = StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
@@ -1493,30 +2103,28 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = span.Z[i];
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (shadow ? !DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr) : !span.DepthPass[i])
         {
-            if (!(dstattr & 0x3)) continue;
+            if (!(dstattr & 0x3) || pixeladdr >= BufferSize) continue;
 
             pixeladdr += BufferSize;
             dstattr = AttrBuffer[pixeladdr];
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
                 continue;
         }
 
-        u32 vr = interpX.Interpolate(rl, rr);
-        u32 vg = interpX.Interpolate(gl, gr);
-        u32 vb = interpX.Interpolate(bl, br);
+        u32 vr = span.R[i];
+        u32 vg = span.G[i];
+        u32 vb = span.B[i];
 
-        s16 s = interpX.Interpolate(sl, sr);
-        s16 t = interpX.Interpolate(tl, tr);
+        s16 s = span.S[i];
+        s16 t = span.T[i];
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel<textured>(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1556,11 +2164,11 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         else
         {
             if (!(polygon->Attr & (1<<11))) z = -1;
-            PlotTranslucentPixel(pixeladdr, color, z, polyattr, polygon->IsShadow);
+            PlotTranslucentPixel(pixeladdr, color, z, polyattr, shadow);
 
             // blend with bottom pixel too, if needed
             if ((dstattr & 0x3) && (pixeladdr < BufferSize))
-                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, polygon->IsShadow);
+                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, shadow);
         }
     }
 
@@ -1577,8 +2185,12 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
         u32 dstattr = AttrBuffer[pixeladdr];
 
+        if ((u32)(x - span.X) >= SpanLength)
+            span.Setup<depthmode, wbuffer, shadow>(interpX, x, pixeladdr, zl, zr, rl, rr, gl, gr, bl, br, sl, sr, tl, tr);
+        int i = x - span.X;
+
         // check stencil buffer for shadows
-        if (polygon->IsShadow)
+        if (shadow)
         {
             u8 stencil = StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
@@ -1589,30 +2201,28 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = span.Z[i];
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (shadow ? !DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr) : !span.DepthPass[i])
         {
-            if (!(dstattr & 0x3)) continue;
+            if (!(dstattr & 0x3) || pixeladdr >= BufferSize) continue;
 
             pixeladdr += BufferSize;
             dstattr = AttrBuffer[pixeladdr];
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
                 continue;
         }
 
-        u32 vr = interpX.Interpolate(rl, rr);
-        u32 vg = interpX.Interpolate(gl, gr);
-        u32 vb = interpX.Interpolate(bl, br);
+        u32 vr = span.R[i];
+        u32 vg = span.G[i];
+        u32 vb = span.B[i];
 
-        s16 s = interpX.Interpolate(sl, sr);
-        s16 t = interpX.Interpolate(tl, tr);
+        s16 s = span.S[i];
+        s16 t = span.T[i];
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel<textured>(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1628,11 +2238,11 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         else
         {
             if (!(polygon->Attr & (1<<11))) z = -1;
-            PlotTranslucentPixel(pixeladdr, color, z, polyattr, polygon->IsShadow);
+            PlotTranslucentPixel(pixeladdr, color, z, polyattr, shadow);
 
             // blend with bottom pixel too, if needed
             if ((dstattr & 0x3) && (pixeladdr < BufferSize))
-                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, polygon->IsShadow);
+                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, shadow);
         }
     }
 
@@ -1652,8 +2262,12 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
         u32 dstattr = AttrBuffer[pixeladdr];
 
+        if ((u32)(x - span.X) >= SpanLength)
+            span.Setup<depthmode, wbuffer, shadow>(interpX, x, pixeladdr, zl, zr, rl, rr, gl, gr, bl, br, sl, sr, tl, tr);
+        int i = x - span.X;
+
         // check stencil buffer for shadows
-        if (polygon->IsShadow)
+        if (shadow)
         {
             u8 stencil = StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
@@ -1664,30 +2278,28 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
-
-        s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
+        s32 z = span.Z[i];
 
         // if depth test against the topmost pixel fails, test
         // against the pixel underneath
-        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+        if (shadow ? !DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr) : !span.DepthPass[i])
         {
-            if (!(dstattr & 0x3)) continue;
+            if (!(dstattr & 0x3) || pixeladdr >= BufferSize) continue;
 
             pixeladdr += BufferSize;
             dstattr = AttrBuffer[pixeladdr];
-            if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+            if (!DepthTest<depthmode, wbuffer>(DepthBuffer[pixeladdr], z, dstattr))
                 continue;
         }
 
-        u32 vr = interpX.Interpolate(rl, rr);
-        u32 vg = interpX.Interpolate(gl, gr);
-        u32 vb = interpX.Interpolate(bl, br);
+        u32 vr = span.R[i];
+        u32 vg = span.G[i];
+        u32 vb = span.B[i];
 
-        s16 s = interpX.Interpolate(sl, sr);
-        s16 t = interpX.Interpolate(tl, tr);
+        s16 s = span.S[i];
+        s16 t = span.T[i];
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel<textured>(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1727,11 +2339,11 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
         else
         {
             if (!(polygon->Attr & (1<<11))) z = -1;
-            PlotTranslucentPixel(pixeladdr, color, z, polyattr, polygon->IsShadow);
+            PlotTranslucentPixel(pixeladdr, color, z, polyattr, shadow);
 
             // blend with bottom pixel too, if needed
             if ((dstattr & 0x3) && (pixeladdr < BufferSize))
-                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, polygon->IsShadow);
+                PlotTranslucentPixel(pixeladdr+BufferSize, color, z, polyattr, shadow);
         }
     }
 
@@ -1739,19 +2351,16 @@ void RenderPolygonScanline(RendererPolygon* rp, s32 y)
     rp->XR = rp->SlopeR.Step();
 }
 
-void RenderScanline(s32 y, int npolys)
+void RenderScanline(RendererPolygon* polylist, s32 y, int npolys)
 {
     for (int i = 0; i < npolys; i++)
     {
-        RendererPolygon* rp = &PolygonList[i];
+        RendererPolygon* rp = &polylist[i];
         Polygon* polygon = rp->PolyData;
 
         if (y >= polygon->YTop && (y < polygon->YBottom || (y == polygon->YTop && polygon->YBottom == polygon->YTop)))
         {
-            if (polygon->IsShadowMask)
-                RenderShadowMaskScanline(rp, y);
-            else
-                RenderPolygonScanline(rp, y);
+            rp->DrawScanline(rp, y);
         }
     }
 }
@@ -2054,20 +2663,178 @@ void ClearBuffers()
     }
 }
 
+RendererPolygon* BandPolygonList[MaxRenderBands];
+int BandNumPolygons;
+
+void RenderBand(int band)
+{
+    s32 ystart = (192 * band) / NumBands;
+    s32 yend = (192 * (band+1)) / NumBands;
+
+    // pick the polygons that cover this band, and move their edges down to
+    // the first line of the band. the edge state only depends on the current
+    // line, so this gives the same result as stepping through the lines above.
+    RendererPolygon* polylist = BandPolygonList[band];
+    int npolys = 0;
+    for (int i = 0; i < BandNumPolygons; i++)
+    {
+        RendererPolygon* rp = &PolygonList[i];
+        Polygon* polygon = rp->PolyData;
+
+        s32 ybot = polygon->YBottom;
+        if (ybot == polygon->YTop) ybot++;
+        if (polygon->YTop >= yend || ybot <= ystart) continue;
+
+        RendererPolygon* bandrp = &polylist[npolys++];
+        *bandrp = *rp;
+
+        if (polygon->YTop < ystart)
+        {
+            SetupPolygonLeftEdge(bandrp, ystart);
+            SetupPolygonRightEdge(bandrp, ystart);
+        }
+    }
+
+    for (s32 y = ystart; y < yend; y++)
+    {
+        RenderScanline(polylist, y, npolys);
+
+        if (y == ystart && band > 0)
+            Platform::Semaphore_Post(Sema_BandFirstLine[band]);
+
+        if (y >= ystart+2)
+            ScanlineFinalPass(y-1);
+    }
+
+    // the final pass for the first and last line of the band looks at the
+    // neighboring bands. those are ran in screen order, after the lines they
+    // need were rendered.
+    if (band > 0)
+        Platform::Semaphore_Wait(Sema_BandLastPass[band-1]);
+
+    ScanlineFinalPass(ystart);
+
+    if (band < NumBands-1)
+        Platform::Semaphore_Wait(Sema_BandFirstLine[band+1]);
+
+    ScanlineFinalPass(yend-1);
+
+    if (band < NumBands-1)
+        Platform::Semaphore_Post(Sema_BandLastPass[band]);
+}
+
+void BandThreadFunc()
+{
+    int band = BandThreadNextID;
+    Platform::Semaphore_Post(Sema_BandThreadInit);
+
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_BandStart[band]);
+        if (!BandThreadsRunning) return;
+
+        RenderBand(band);
+
+        Platform::Semaphore_Post(Sema_BandDone[band]);
+    }
+}
+
+void StopBandThreads()
+{
+    if (!BandThreadsRunning) return;
+
+    BandThreadsRunning = false;
+    for (int i = 1; i < NumBands; i++)
+    {
+        Platform::Semaphore_Post(Sema_BandStart[i]);
+        Platform::Thread_Wait(BandThread[i]);
+        Platform::Thread_Free(BandThread[i]);
+    }
+
+    for (int i = 0; i < NumBands; i++)
+        delete[] BandPolygonList[i];
+
+    NumBands = 1;
+}
+
+void SetupBandThreads(int num)
+{
+    StopBandThreads();
+    if (num < 2) return;
+
+    NumBands = num;
+    BandThreadsRunning = true;
+
+    for (int i = 0; i < NumBands; i++)
+        BandPolygonList[i] = new RendererPolygon[2048];
+
+    // the platform threads don't take an argument, so each worker picks
+    // up its band number before the next one is started
+    for (int i = 1; i < NumBands; i++)
+    {
+        BandThreadNextID = i;
+        BandThread[i] = Platform::Thread_Create(BandThreadFunc);
+        Platform::Semaphore_Wait(Sema_BandThreadInit);
+    }
+}
+
+void RenderPolygonsBanded(bool threaded, int npolys)
+{
+    BandNumPolygons = npolys;
+
+    // nothing in the frame will set PrevIsShadowMask, so the state it is
+    // left in can be set right away, before the bands start reading it
+    if (npolys > 0)
+        PrevIsShadowMask = false;
+
+    for (int i = 1; i < NumBands; i++)
+        Platform::Semaphore_Post(Sema_BandStart[i]);
+
+    RenderBand(0);
+
+    for (int i = 0; i < NumBands; i++)
+    {
+        if (i > 0)
+            Platform::Semaphore_Wait(Sema_BandDone[i]);
+
+        if (threaded)
+        {
+            s32 ystart = (192 * i) / NumBands;
+            s32 yend = (192 * (i+1)) / NumBands;
+            for (s32 y = ystart; y < yend; y++)
+                Platform::Semaphore_Post(Sema_ScanlineCount);
+        }
+    }
+}
+
 void RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 {
+    if (NewNumBands != NumBands)
+        SetupBandThreads(NewNumBands);
+
+    // shadow masks carry stencil state from one line to the next, so
+    // frames that use them are rendered in one go
+    bool shadowmask = false;
+
     int j = 0;
     for (int i = 0; i < npolys; i++)
     {
         if (polygons[i]->Degenerate) continue;
+        if (polygons[i]->IsShadowMask) shadowmask = true;
         SetupPolygon(&PolygonList[j++], polygons[i]);
     }
 
-    RenderScanline(0, j);
+    if (NumBands > 1 && !shadowmask)
+    {
+        RenderPolygonsBanded(threaded, j);
+        return;
+    }
+
+    RenderScanline(PolygonList, 0, j);
 
     for (s32 y = 1; y < 192; y++)
     {
-        RenderScanline(y, j);
+        RenderScanline(PolygonList, y, j);
         ScanlineFinalPass(y-1);
 
         if (threaded)
@@ -2088,6 +2855,9 @@ void VCount144()
 
 void RenderFrame()
 {
+    // the rendering thread is idle at this point
+    UpdateTexCache();
+
     if (RenderThreadRunning)
     {
         Platform::Semaphore_Post(Sema_RenderStart);
@@ -18,6 +18,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include "Config.h"
 #include "NDS.h"
 #include "ARM.h"
@@ -83,6 +85,41 @@ int CurCPU;
 
 const s32 kMaxIterationCycles = 64;
 
+// parallel CPU mode: the ARM7 can run ahead on its own thread, over a window
+// that goes up to the next scheduled event, while the ARM9 runs the same
+// window on the emu thread. the result is the same as running the window as
+// one big iteration, ARM9 first, then ARM7.
+// while in a window, the ARM7 may only access its own memory. anything else,
+// or the ARM9 side doing something the ARM7 could see, rolls the ARM7 back
+// to the start of the window and it is run again once the ARM9 is done.
+// the ARM7 thread owns ARM7Timestamp/ARM7Target during a window, it runs in
+// slices so it can pick up a lower stop target from the emu thread.
+const s32 kMinParallelCycles = 256;
+const s32 kParallelSliceCycles = 64;
+const u32 kParallelUndoMax = 0x4000;
+
+struct ParallelUndoEntry
+{
+    u8* Ptr;
+    u32 Val;
+    u32 Size;
+};
+
+void* ParallelThread;
+bool ParallelThreadRunning;
+void* Sema_ParallelStart;
+void* Sema_ParallelDone;
+
+bool ParallelActive;
+std::atomic<bool> ParallelConflict;
+std::atomic<u64> ParallelStopTarget;
+u64 ParallelStartTimestamp;
+u64 ParallelStartIdleSkip;
+ARMv4* ARM7Snapshot;
+
+ParallelUndoEntry ParallelUndo[kParallelUndoMax];
+u32 ParallelUndoLen;
+
 u32 ARM9ClockShift;
 
 // no need to worry about those overflowing, they can keep going for atleast 4350 years
@@ -90,8 +127,12 @@ u64 ARM9Timestamp, ARM9Target;
 u64 ARM7Timestamp, ARM7Target;
 u64 SysTimestamp;
 
+// pending events are kept in a binary min-heap ordered by timestamp
+// SchedHeapPos[id] is the position of the event in the heap, -1 if it isn't scheduled
 SchedEvent SchedList[Event_MAX];
-u32 SchedListMask;
+u32 SchedHeap[Event_MAX];
+s32 SchedHeapPos[Event_MAX];
+u32 SchedHeapSize;
 
 u32 CPUStop;
 
@@ -160,12 +201,22 @@ bool Running;
 
 bool RunningGame;
 
+// interpreter idle loop skipping, see ARM::CheckIdleLoop()
+// the skipped cycles are counted in each CPU's own clock
+bool IdleSkip;
+u64 IdleSkipCycles[2];
+
 
 void DivDone(u32 param);
 void SqrtDone(u32 param);
 void RunTimer(u32 tid, s32 cycles);
 void SetWifiWaitCnt(u16 val);
 void SetGBASlotTimings();
+void ClearSchedHeap();
+void SchedHeapInsert(u32 id);
+void StopParallelThread();
+void SyncParallelWindow();
+void UpdateIdleSkip(const char* gamecode);
 
 
 bool Init()
@@ -193,6 +244,14 @@ bool Init()
     IPCFIFO9 = new FIFO<u32>(16);
     IPCFIFO7 = new FIFO<u32>(16);
 
+    ClearSchedHeap();
+
+    ARM7Snapshot = new ARMv4();
+    Sema_ParallelStart = Platform::Semaphore_Create();
+    Sema_ParallelDone = Platform::Semaphore_Create();
+    ParallelThreadRunning = false;
+    ParallelActive = false;
+
     if (!NDSCart::Init()) return false;
     if (!GBACart::Init()) return false;
     if (!GPU::Init()) return false;
@@ -210,6 +269,11 @@ bool Init()
 
 void DeInit()
 {
+    StopParallelThread();
+    Platform::Semaphore_Free(Sema_ParallelStart);
+    Platform::Semaphore_Free(Sema_ParallelDone);
+    delete ARM7Snapshot;
+
     delete ARM9;
     delete ARM7;
 
@@ -454,6 +518,10 @@ void Reset()
     RunningGame = false;
     LastSysClockCycles = 0;
 
+    UpdateIdleSkip(NULL);
+    IdleSkipCycles[0] = 0;
+    IdleSkipCycles[1] = 0;
+
     memset(ARM9BIOS, 0, 0x1000);
     memset(ARM7BIOS, 0, 0x4000);
 
@@ -578,7 +646,7 @@ void Reset()
     memset(DMA9Fill, 0, 4*4);
 
     memset(SchedList, 0, sizeof(SchedList));
-    SchedListMask = 0;
+    ClearSchedHeap();
 
     KeyInput = 0x007F03FF;
     KeyCnt = 0;
@@ -706,6 +774,12 @@ bool DoSavestate(Savestate* file)
 {
     file->Section("NDSG");
 
+#ifdef JIT_ENABLED
+    // remember the code memory, to find out which blocks are still valid after loading
+    if (!file->Saving)
+        ARMJIT::PrepareStateLoad();
+#endif
+
     // TODO:
     // * do something for bool's (sizeof=1)
     // * do something for 'loading DSi-mode savestate in DS mode' and vice-versa
@@ -758,8 +832,60 @@ bool DoSavestate(Savestate* file)
 
     file->VarArray(DMA9Fill, 4*sizeof(u32));
 
-    if (!DoSavestate_Scheduler(file)) return false;
-    file->Var32(&SchedListMask);
+    if (!DoSavestate_Scheduler(file))
+    {
+#ifdef JIT_ENABLED
+        if (!file->Saving)
+            ARMJIT::ResetBlockCache();
+#endif
+        return false;
+    }
+    if (file->IsAtleastVersion(6, 1))
+    {
+        // heap contents, padded to Event_MAX entries so the state size stays the same
+        u32 heapsize = SchedHeapSize;
+        file->Var32(&heapsize);
+        if (!file->Saving)
+        {
+            ClearSchedHeap();
+            if (heapsize > Event_MAX)
+            {
+                printf("savestate: bad scheduler heap size %d\n", heapsize);
+                return false;
+            }
+        }
+
+        for (int i = 0; i < Event_MAX; i++)
+        {
+            u32 id = ((u32)i < heapsize) ? SchedHeap[i] : 0xFFFFFFFF;
+            u64 timestamp = (id != 0xFFFFFFFF) ? SchedList[id].Timestamp : 0;
+            file->Var32(&id);
+            file->Var64(&timestamp);
+
+            if (!file->Saving && (u32)i < heapsize)
+            {
+                if (id >= Event_MAX || SchedHeapPos[id] != -1)
+                {
+                    printf("savestate: bad scheduler heap entry %d\n", id);
+                    ClearSchedHeap();
+                    return false;
+                }
+                SchedList[id].Timestamp = timestamp;
+                SchedHeapInsert(id);
+            }
+        }
+    }
+    else
+    {
+        u32 schedmask;
+        file->Var32(&schedmask);
+        ClearSchedHeap();
+        for (int i = 0; i < 32 && i < Event_MAX; i++)
+        {
+            if (schedmask & (1<<i))
+                SchedHeapInsert(i);
+        }
+    }
     file->Var64(&ARM9Timestamp);
     file->Var64(&ARM9Target);
     file->Var64(&ARM7Timestamp);
@@ -812,10 +938,7 @@ bool DoSavestate(Savestate* file)
 
 #ifdef JIT_ENABLED
     if (!file->Saving)
-    {
-        ARMJIT::ResetBlockCache();
-        ARMJIT_Memory::Reset();
-    }
+        ARMJIT::FinishStateLoad();
 #endif
 
     return true;
@@ -828,8 +951,17 @@ void SetConsoleType(int type)
 
 bool LoadROM(const char* path, const char* sram, bool direct)
 {
+#ifdef JIT_ENABLED
+    ARMJIT::SaveLiteralCache();
+#endif
+
     if (NDSCart::LoadROM(path, sram, direct))
     {
+        UpdateIdleSkip((const char*)&NDSCart::CartROM[0x0C]);
+#ifdef JIT_ENABLED
+        // the CRC goes through the whole ROM, so only compute it if it's needed
+        ARMJIT::LoadLiteralCache((Config::JIT_Enable && Config::JIT_PersistentCache) ? NDSCart::GetCartCRC() : 0);
+#endif
         Running = true;
         return true;
     }
@@ -853,6 +985,52 @@ bool LoadGBAROM(const char* path, const char* sram)
     }
 }
 
+void UpdateIdleSkip(const char* gamecode)
+{
+    // the allow-list holds game codes separated by commas or spaces
+    // if it is empty, idle loops are skipped for everything
+    IdleSkip = false;
+    if (!Config::IdleSkip) return;
+
+    const char* list = Config::IdleSkipGames;
+    if (!list[0])
+    {
+        IdleSkip = true;
+        return;
+    }
+    if (!gamecode) return;
+
+    while (*list)
+    {
+        if (*list == ',' || *list == ' ')
+        {
+            list++;
+            continue;
+        }
+
+        int len = 0;
+        while (list[len] && list[len] != ',' && list[len] != ' ')
+            len++;
+
+        if (len == 4 && !strncmp(list, gamecode, 4))
+        {
+            IdleSkip = true;
+            return;
+        }
+
+        list += len;
+    }
+}
+
+void GetIdleSkipCycles(u64* arm9, u64* arm7)
+{
+    *arm9 = IdleSkipCycles[0] >> ARM9ClockShift;
+    *arm7 = IdleSkipCycles[1];
+
+    IdleSkipCycles[0] = 0;
+    IdleSkipCycles[1] = 0;
+}
+
 void LoadBIOS()
 {
     Reset();
@@ -867,22 +1045,85 @@ void RelocateSave(const char* path, bool write)
 
 
 
-u64 NextTarget()
+bool SchedBefore(u32 a, u32 b)
 {
-    u64 ret = SysTimestamp + kMaxIterationCycles;
+    // ties are broken by event ID, so the order doesn't depend on the heap layout
+    if (SchedList[a].Timestamp != SchedList[b].Timestamp)
+        return SchedList[a].Timestamp < SchedList[b].Timestamp;
+    return a < b;
+}
 
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+void SchedHeapSet(u32 pos, u32 id)
+{
+    SchedHeap[pos] = id;
+    SchedHeapPos[id] = pos;
+}
+
+void SchedHeapSiftUp(u32 pos)
+{
+    u32 id = SchedHeap[pos];
+    while (pos > 0)
     {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            if (SchedList[i].Timestamp < ret)
-                ret = SchedList[i].Timestamp;
-        }
+        u32 parent = (pos - 1) >> 1;
+        if (!SchedBefore(id, SchedHeap[parent])) break;
+
+        SchedHeapSet(pos, SchedHeap[parent]);
+        pos = parent;
+    }
+    SchedHeapSet(pos, id);
+}
+
+void SchedHeapSiftDown(u32 pos)
+{
+    u32 id = SchedHeap[pos];
+    for (;;)
+    {
+        u32 child = (pos << 1) + 1;
+        if (child >= SchedHeapSize) break;
+        if ((child + 1) < SchedHeapSize && SchedBefore(SchedHeap[child + 1], SchedHeap[child]))
+            child++;
+        if (!SchedBefore(SchedHeap[child], id)) break;
 
-        mask >>= 1;
+        SchedHeapSet(pos, SchedHeap[child]);
+        pos = child;
     }
+    SchedHeapSet(pos, id);
+}
+
+void SchedHeapInsert(u32 id)
+{
+    SchedHeapSet(SchedHeapSize++, id);
+    SchedHeapSiftUp(SchedHeapSize - 1);
+}
+
+void SchedHeapRemove(u32 id)
+{
+    u32 pos = SchedHeapPos[id];
+    SchedHeapPos[id] = -1;
+
+    SchedHeapSize--;
+    if (pos == SchedHeapSize) return;
+
+    SchedHeapSet(pos, SchedHeap[SchedHeapSize]);
+    if (pos > 0 && SchedBefore(SchedHeap[pos], SchedHeap[(pos - 1) >> 1]))
+        SchedHeapSiftUp(pos);
+    else
+        SchedHeapSiftDown(pos);
+}
+
+void ClearSchedHeap()
+{
+    SchedHeapSize = 0;
+    for (int i = 0; i < Event_MAX; i++)
+        SchedHeapPos[i] = -1;
+}
+
+u64 NextTarget()
+{
+    u64 ret = SysTimestamp + kMaxIterationCycles;
+
+    if (SchedHeapSize && SchedList[SchedHeap[0]].Timestamp < ret)
+        ret = SchedList[SchedHeap[0]].Timestamp;
 
     return ret;
 }
@@ -891,94 +1132,277 @@ void RunSystem(u64 timestamp)
 {
     SysTimestamp = timestamp;
 
-    u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+    if (!SchedHeapSize || SchedList[SchedHeap[0]].Timestamp > SysTimestamp)
+        return;
+
+    // gather the events that are due, walking only the part of the heap
+    // that is below the current timestamp
+    u32 due[Event_MAX];
+    u32 numdue = 0;
+    u32 stack[Event_MAX];
+    u32 stacklen = 0;
+
+    stack[stacklen++] = 0;
+    while (stacklen)
     {
-        if (!mask) break;
-        if (mask & 0x1)
+        u32 pos = stack[--stacklen];
+        u32 id = SchedHeap[pos];
+        if (SchedList[id].Timestamp > SysTimestamp) continue;
+
+        // keep them sorted by ID, events that are due together run in ID order
+        u32 i = numdue++;
+        while (i > 0 && due[i-1] > id)
         {
-            if (SchedList[i].Timestamp <= SysTimestamp)
-            {
-                SchedListMask &= ~(1<<i);
-                SchedList[i].Func(SchedList[i].Param);
-            }
+            due[i] = due[i-1];
+            i--;
         }
+        due[i] = id;
+
+        u32 child = (pos << 1) + 1;
+        if (child < SchedHeapSize) stack[stacklen++] = child;
+        if ((child + 1) < SchedHeapSize) stack[stacklen++] = child + 1;
+    }
+
+    for (u32 i = 0; i < numdue; i++)
+    {
+        u32 id = due[i];
+
+        // an earlier event may have cancelled or moved this one
+        if (SchedHeapPos[id] == -1) continue;
+        if (SchedList[id].Timestamp > SysTimestamp) continue;
 
-        mask >>= 1;
+        SchedHeapRemove(id);
+        SchedList[id].Func(SchedList[id].Param);
     }
 }
 
 template <bool EnableJIT>
-u32 RunFrame()
+void RunARM9()
 {
-    FrameStartTimestamp = SysTimestamp;
+    CurCPU = 0;
 
-    if (!Running) return 263; // dorp
-    if (CPUStop & 0x40000000) return 263;
-
-    GPU::StartFrame();
+    if (CPUStop & 0x80000000)
+    {
+        // GXFIFO stall
+        s32 cycles = GPU3D::CyclesToRunFor();
 
-    while (Running && GPU::TotalScanlines==0)
+        ARM9Timestamp = std::min(ARM9Target, ARM9Timestamp+(cycles<<ARM9ClockShift));
+    }
+    else if (CPUStop & 0x0FFF)
+    {
+        DMAs[0]->Run();
+        if (!(CPUStop & 0x80000000)) DMAs[1]->Run();
+        if (!(CPUStop & 0x80000000)) DMAs[2]->Run();
+        if (!(CPUStop & 0x80000000)) DMAs[3]->Run();
+        if (ConsoleType == 1) DSi::RunNDMAs(0);
+    }
+    else
     {
-        // TODO: give it some margin, so it can directly do 17 cycles instead of 16 then 1
-        u64 target = NextTarget();
-        ARM9Target = target << ARM9ClockShift;
-        CurCPU = 0;
+#ifdef JIT_ENABLED
+        if (EnableJIT)
+            ARM9->ExecuteJIT();
+        else
+#endif
+            ARM9->Execute();
+    }
 
-        if (CPUStop & 0x80000000)
-        {
-            // GXFIFO stall
-            s32 cycles = GPU3D::CyclesToRunFor();
+    RunTimers(0);
+    GPU3D::Run();
+}
 
-            ARM9Timestamp = std::min(ARM9Target, ARM9Timestamp+(cycles<<ARM9ClockShift));
-        }
-        else if (CPUStop & 0x0FFF)
+template <bool EnableJIT>
+void RunARM7(u64 target)
+{
+    CurCPU = 1;
+
+    while (ARM7Timestamp < target)
+    {
+        ARM7Target = target; // might be changed by a reschedule
+
+        if (CPUStop & 0x0FFF0000)
         {
-            DMAs[0]->Run();
-            if (!(CPUStop & 0x80000000)) DMAs[1]->Run();
-            if (!(CPUStop & 0x80000000)) DMAs[2]->Run();
-            if (!(CPUStop & 0x80000000)) DMAs[3]->Run();
-            if (ConsoleType == 1) DSi::RunNDMAs(0);
+            DMAs[4]->Run();
+            DMAs[5]->Run();
+            DMAs[6]->Run();
+            DMAs[7]->Run();
+            if (ConsoleType == 1) DSi::RunNDMAs(1);
         }
         else
         {
 #ifdef JIT_ENABLED
             if (EnableJIT)
-                ARM9->ExecuteJIT();
+                ARM7->ExecuteJIT();
             else
 #endif
-                ARM9->Execute();
+                ARM7->Execute();
         }
 
-        RunTimers(0);
-        GPU3D::Run();
+        RunTimers(1);
+    }
+}
 
-        target = ARM9Timestamp >> ARM9ClockShift;
-        CurCPU = 1;
+void ParallelThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_ParallelStart);
+        if (!ParallelThreadRunning) break;
 
-        while (ARM7Timestamp < target)
+        for (;;)
         {
-            ARM7Target = target; // might be changed by a reschedule
+            u64 stop = ParallelStopTarget.load(std::memory_order_acquire);
+            if (ARM7Timestamp >= stop) break;
+            if (ParallelConflict.load(std::memory_order_relaxed)) break;
+            if (ARM7->Halted) break; // the emu thread takes it from there
 
-            if (CPUStop & 0x0FFF0000)
-            {
-                DMAs[4]->Run();
-                DMAs[5]->Run();
-                DMAs[6]->Run();
-                DMAs[7]->Run();
-                if (ConsoleType == 1) DSi::RunNDMAs(1);
-            }
-            else
-            {
+            ARM7Target = std::min(stop, ARM7Timestamp + kParallelSliceCycles);
+            ARM7->Execute();
+        }
+
+        Platform::Semaphore_Post(Sema_ParallelDone);
+    }
+}
+
+void StopParallelThread()
+{
+    if (!ParallelThreadRunning) return;
+
+    ParallelThreadRunning = false;
+    Platform::Semaphore_Post(Sema_ParallelStart);
+    Platform::Thread_Wait(ParallelThread);
+    Platform::Thread_Free(ParallelThread);
+}
+
+void RollbackParallelWindow()
+{
+    for (s32 i = ParallelUndoLen - 1; i >= 0; i--)
+    {
+        ParallelUndoEntry& undo = ParallelUndo[i];
+        switch (undo.Size)
+        {
+        case 1: *(u8*)undo.Ptr = undo.Val; break;
+        case 2: *(u16*)undo.Ptr = undo.Val; break;
+        case 4: *(u32*)undo.Ptr = undo.Val; break;
+        }
+    }
+
+    // the IRQ line isn't the ARM7's to change, keep its current state
+    u8 irq = ARM7->IRQ;
+    *ARM7 = *ARM7Snapshot;
+    ARM7->IRQ = irq;
+
+    ARM7Timestamp = ParallelStartTimestamp;
+    IdleSkipCycles[1] = ParallelStartIdleSkip;
+}
+
+void SyncParallelWindow()
+{
+    // the ARM9 side is about to change something the ARM7 can see
+    // stop the ARM7 thread and throw away what it ran, it will be run
+    // again once the ARM9 is done with this window
+    if (!ParallelActive) return;
+
+    ParallelStopTarget.store(0, std::memory_order_release);
+    Platform::Semaphore_Wait(Sema_ParallelDone);
+    ParallelActive = false;
+
+    RollbackParallelWindow();
+}
+
+bool RunParallelWindow(u64& target)
+{
+    // only start a window if the ARM7 is running code and will keep doing
+    // so on its own until the next event
+    if (CPUStop & 0x0FFF0000) return false;
+    if (ARM7->Halted) return false;
+    if (TimerCheckMask[1]) return false;
+    if (!SchedHeapSize) return false;
+
+    u64 end = SchedList[SchedHeap[0]].Timestamp;
+    if (end < SysTimestamp + kMaxIterationCycles) return false;
+    if (end < ARM7Timestamp + kMinParallelCycles) return false;
+
+    if (!ParallelThreadRunning)
+    {
+        ParallelThreadRunning = true;
+        ParallelThread = Platform::Thread_Create(ParallelThreadFunc);
+    }
+
+    *ARM7Snapshot = *ARM7;
+    ParallelStartTimestamp = ARM7Timestamp;
+    ParallelStartIdleSkip = IdleSkipCycles[1];
+    ParallelUndoLen = 0;
+    ParallelConflict.store(false, std::memory_order_relaxed);
+
+    ARM7->SetParallelBus(true);
+    ParallelStopTarget.store(end, std::memory_order_relaxed);
+    ParallelActive = true;
+    Platform::Semaphore_Post(Sema_ParallelStart);
+
+    for (;;)
+    {
+        ARM9Target = NextTarget() << ARM9ClockShift;
+        RunARM9<false>();
+
+        target = ARM9Timestamp >> ARM9ClockShift;
+        if (target >= end || !ParallelActive || !Running) break;
+
+        // events scheduled by the ARM9 during the window can run right away
+        // anything they do that the ARM7 could see goes through SyncParallelWindow()
+        RunSystem(target);
+        if (!ParallelActive) break;
+    }
+
+    if (ParallelActive)
+    {
+        // if the window was cut short, the ARM7 has to be run again
+        // unless it stopped right where the ARM9 did
+        if (target < end)
+            ParallelStopTarget.store(target, std::memory_order_release);
+
+        Platform::Semaphore_Wait(Sema_ParallelDone);
+        ParallelActive = false;
+
+        if (ParallelConflict.load(std::memory_order_relaxed) || (ARM7Timestamp > target && target < end))
+            RollbackParallelWindow();
+        else
+            ARM7->SetParallelBus(false);
+    }
+
+    RunARM7<false>(target);
+    return true;
+}
+
+template <bool EnableJIT>
+u32 RunFrame()
+{
+    FrameStartTimestamp = SysTimestamp;
+
+    if (!Running) return 263; // dorp
+    if (CPUStop & 0x40000000) return 263;
+
+    GPU::StartFrame();
+
+    // the ARM7 thread relies on the interpreter going through the bus functions
+    bool parallel = !EnableJIT && Config::ParallelCPUs && ConsoleType == 0;
 #ifdef JIT_ENABLED
-                if (EnableJIT)
-                    ARM7->ExecuteJIT();
-                else
+    // the decode cache needs every write to go through the invalidation hooks
+    ARMJIT::SetExecutionMode(EnableJIT, Config::JIT_DecodeCache && !parallel);
 #endif
-                    ARM7->Execute();
-            }
 
-            RunTimers(1);
+    while (Running && GPU::TotalScanlines==0)
+    {
+        u64 target;
+
+        if (!(parallel && RunParallelWindow(target)))
+        {
+            // TODO: give it some margin, so it can directly do 17 cycles instead of 16 then 1
+            target = NextTarget();
+            ARM9Target = target << ARM9ClockShift;
+            RunARM9<EnableJIT>();
+
+            target = ARM9Timestamp >> ARM9ClockShift;
+            RunARM7<EnableJIT>(target);
         }
 
         RunSystem(target);
@@ -1031,7 +1455,7 @@ void Reschedule(u64 target)
 
 void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 param)
 {
-    if (SchedListMask & (1<<id))
+    if (SchedHeapPos[id] != -1)
     {
         printf("!! EVENT %d ALREADY SCHEDULED\n", id);
         return;
@@ -1052,14 +1476,21 @@ void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 para
     evt->Func = func;
     evt->Param = param;
 
-    SchedListMask |= (1<<id);
+    SchedHeapInsert(id);
 
     Reschedule(evt->Timestamp);
 }
 
 void CancelEvent(u32 id)
 {
-    SchedListMask &= ~(1<<id);
+    if (SchedHeapPos[id] != -1)
+        SchedHeapRemove(id);
+}
+
+void GetEvent(u32 id, u64* timestamp, u32* param)
+{
+    *timestamp = SchedList[id].Timestamp;
+    *param = SchedList[id].Param;
 }
 
 
@@ -1137,6 +1568,8 @@ void MapSharedWRAM(u8 val)
     if (val == WRAMCnt)
         return;
 
+    SyncParallelWindow();
+
 #ifdef JIT_ENABLED
     ARMJIT_Memory::RemapSWRAM();
 #endif
@@ -1221,6 +1654,8 @@ void SetGBASlotTimings()
 
 void UpdateIRQ(u32 cpu)
 {
+    if (cpu) SyncParallelWindow();
+
     ARM* arm = cpu ? (ARM*)ARM7 : (ARM*)ARM9;
 
     if (IME[cpu] & 0x1)
@@ -1280,6 +1715,7 @@ void StopCPU(u32 cpu, u32 mask)
 {
     if (cpu)
     {
+        SyncParallelWindow();
         CPUStop |= (mask << 16);
         ARM7->Halt(2);
     }
@@ -2757,6 +3193,97 @@ bool ARM7GetMemRegion(u32 addr, bool write, MemRegion* region)
 }
 
 
+// bus used by the ARM7 while it runs on its own thread
+// only its private memory can be accessed, anything else ends the window
+
+void ParallelARM7Conflict()
+{
+    // called on the ARM7 thread, which owns ARM7Target during the window
+    ParallelConflict.store(true, std::memory_order_relaxed);
+    ARM7Target = 0;
+}
+
+u8* ParallelARM7Mem(u32 addr)
+{
+    switch (addr & 0xFF800000)
+    {
+    case 0x03000000:
+        if (SWRAM_ARM7.Mem)
+            return &SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask];
+        else
+            return &ARM7WRAM[addr & (ARM7WRAMSize - 1)];
+
+    case 0x03800000:
+        return &ARM7WRAM[addr & (ARM7WRAMSize - 1)];
+    }
+
+    return NULL;
+}
+
+template <typename T>
+T ParallelARM7Read(u32 addr, T (*busread)(u32))
+{
+    // the BIOS never changes, the protection only depends on the ARM7 itself
+    if (addr < 0x00004000)
+        return busread(addr);
+
+    u8* mem = ParallelARM7Mem(addr);
+    if (mem)
+        return *(T*)mem;
+
+    ParallelARM7Conflict();
+    return 0;
+}
+
+template <typename T>
+void ParallelARM7Write(u32 addr, T val)
+{
+    u8* mem = ParallelARM7Mem(addr);
+    if (!mem || ParallelUndoLen >= kParallelUndoMax)
+    {
+        ParallelARM7Conflict();
+        return;
+    }
+
+    ParallelUndoEntry& undo = ParallelUndo[ParallelUndoLen++];
+    undo.Ptr = mem;
+    undo.Val = *(T*)mem;
+    undo.Size = sizeof(T);
+
+    *(T*)mem = val;
+}
+
+u8 ParallelARM7Read8(u32 addr)
+{
+    return ParallelARM7Read<u8>(addr, ARM7Read8);
+}
+
+u16 ParallelARM7Read16(u32 addr)
+{
+    return ParallelARM7Read<u16>(addr, ARM7Read16);
+}
+
+u32 ParallelARM7Read32(u32 addr)
+{
+    return ParallelARM7Read<u32>(addr, ARM7Read32);
+}
+
+void ParallelARM7Write8(u32 addr, u8 val)
+{
+    ParallelARM7Write<u8>(addr, val);
+}
+
+void ParallelARM7Write16(u32 addr, u16 val)
+{
+    ParallelARM7Write<u16>(addr, val);
+}
+
+void ParallelARM7Write32(u32 addr, u32 val)
+{
+    ParallelARM7Write<u32>(addr, val);
+}
+
+
 
 
 #define CASE_READ8_16BIT(addr, val) \
@@ -145,6 +145,9 @@ extern u64 ARM9Timestamp, ARM9Target;
 extern u64 ARM7Timestamp, ARM7Target;
 extern u32 ARM9ClockShift;
 
+// current system time (in ARM7 cycles) as seen by scheduler events
+extern u64 SysTimestamp;
+
 extern u32 IME[2];
 extern u32 IE[2];
 extern u32 IF[2];
@@ -177,6 +180,9 @@ extern MemRegion SWRAM_ARM7;
 
 extern u32 KeyInput;
 
+extern bool IdleSkip;
+extern u64 IdleSkipCycles[2];
+
 const u32 ARM7WRAMSize = 0x10000;
 extern u8* ARM7WRAM;
 
@@ -201,6 +207,9 @@ void RelocateSave(const char* path, bool write);
 
 u32 RunFrame();
 
+// cycles skipped in idle loops since the last call, in system clock cycles
+void GetIdleSkipCycles(u64* arm9, u64* arm7);
+
 void TouchScreen(u16 x, u16 y);
 void ReleaseScreen();
 
@@ -213,6 +222,7 @@ void MicInputFrame(s16* data, int samples);
 
 void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 param);
 void CancelEvent(u32 id);
+void GetEvent(u32 id, u64* timestamp, u32* param);
 
 void debug(u32 p);
 
@@ -262,6 +272,13 @@ void ARM7Write32(u32 addr, u32 val);
 
 bool ARM7GetMemRegion(u32 addr, bool write, MemRegion* region);
 
+u8 ParallelARM7Read8(u32 addr);
+u16 ParallelARM7Read16(u32 addr);
+u32 ParallelARM7Read32(u32 addr);
+void ParallelARM7Write8(u32 addr, u8 val);
+void ParallelARM7Write16(u32 addr, u16 val);
+void ParallelARM7Write32(u32 addr, u32 val);
+
 u8 ARM9IORead8(u32 addr);
 u16 ARM9IORead16(u32 addr);
 u32 ARM9IORead32(u32 addr);
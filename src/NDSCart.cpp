@@ -18,6 +18,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#if !defined(_WIN32) && !defined(__SWITCH__)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "NDS.h"
 #include "DSi.h"
 #include "NDSCart.h"
@@ -48,6 +54,27 @@ u8 Data;
 u8 StatusReg;
 u32 Addr;
 
+// SRAM range modified since the last flush
+u32 DirtyStart, DirtyEnd;
+
+// background writer
+// FlushBuffer mirrors SRAM as of the last flush request, and FlushStart/FlushEnd
+// is the range of it that still has to be written. both are protected by Sema_FlushLock
+// WriteBuffer is the writer thread's own copy, the file is written from it
+// without holding the lock
+bool FlushThreadRunning;
+void* FlushThread;
+void* Sema_FlushRequest;
+void* Sema_FlushLock;
+u8* FlushBuffer;
+u8* WriteBuffer;
+u32 FlushLength;
+u32 FlushStart, FlushEnd;
+
+// games write their saves one command at a time, wait a bit
+// so that a burst of them ends up in a single write
+const u32 kFlushDelay = 50; // ms
+
 
 void Write_Null(u8 val, bool islast);
 void Write_EEPROMTiny(u8 val, bool islast);
@@ -55,19 +82,160 @@ void Write_EEPROM(u8 val, bool islast);
 void Write_Flash(u8 val, bool islast);
 
 
+void WriteSaveRange(u8* buf, u32 len, u32 start, u32 end)
+{
+    // only rewrite the modified part of the file, if it already exists.
+    // when the whole save is modified (ie. after loading a savestate), the file
+    // is recreated instead, so its size follows the save length
+    FILE* f;
+    if (start > 0 || end < len)
+    {
+        f = Platform::OpenFile(SRAMPath, "r+b", true);
+        if (f)
+        {
+            fseek(f, start, SEEK_SET);
+            fwrite(&buf[start], end-start, 1, f);
+            fclose(f);
+            return;
+        }
+    }
+
+    f = Platform::OpenFile(SRAMPath, "wb");
+    if (f)
+    {
+        fwrite(buf, len, 1, f);
+        fclose(f);
+    }
+}
+
+void FlushThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_FlushRequest);
+
+        Platform::Semaphore_Wait(Sema_FlushLock);
+        bool running = FlushThreadRunning;
+        Platform::Semaphore_Post(Sema_FlushLock);
+
+        if (running)
+            Platform::Thread_Sleep(kFlushDelay);
+
+        // requests that came in meanwhile were merged into the pending range,
+        // only take it over here, so the emulator isn't held up by the file access
+        Platform::Semaphore_Wait(Sema_FlushLock);
+        u32 start = FlushStart;
+        u32 end = FlushEnd;
+        if (start < end)
+            memcpy(&WriteBuffer[start], &FlushBuffer[start], end-start);
+        FlushStart = 0xFFFFFFFF;
+        FlushEnd = 0;
+        running = FlushThreadRunning;
+        Platform::Semaphore_Post(Sema_FlushLock);
+
+        if (start < end)
+            WriteSaveRange(WriteBuffer, FlushLength, start, end);
+
+        if (!running) return;
+    }
+}
+
+void StopFlushThread()
+{
+    if (!FlushThreadRunning) return;
+
+    // the thread writes any pending data before exiting
+    Platform::Semaphore_Wait(Sema_FlushLock);
+    FlushThreadRunning = false;
+    Platform::Semaphore_Post(Sema_FlushLock);
+
+    Platform::Semaphore_Post(Sema_FlushRequest);
+    Platform::Thread_Wait(FlushThread);
+    Platform::Thread_Free(FlushThread);
+
+    Platform::Semaphore_Free(Sema_FlushRequest);
+    Platform::Semaphore_Free(Sema_FlushLock);
+
+    delete[] FlushBuffer;
+    delete[] WriteBuffer;
+    FlushBuffer = NULL;
+    WriteBuffer = NULL;
+}
+
+void StartFlushThread()
+{
+    StopFlushThread();
+
+    DirtyStart = 0xFFFFFFFF;
+    DirtyEnd = 0;
+
+    if (!Config::SaveFlushAsync) return;
+    if (WriteFunc == Write_Null) return;
+
+    FlushLength = SRAMLength;
+    FlushBuffer = new u8[FlushLength];
+    WriteBuffer = new u8[FlushLength];
+    memcpy(FlushBuffer, SRAM, FlushLength);
+    memcpy(WriteBuffer, SRAM, FlushLength);
+    FlushStart = 0xFFFFFFFF;
+    FlushEnd = 0;
+
+    Sema_FlushRequest = Platform::Semaphore_Create();
+    Sema_FlushLock = Platform::Semaphore_Create();
+    Platform::Semaphore_Post(Sema_FlushLock);
+
+    FlushThreadRunning = true;
+    FlushThread = Platform::Thread_Create(FlushThreadFunc);
+}
+
+void Flush()
+{
+    if (DirtyStart >= DirtyEnd) return;
+
+    if (FlushThreadRunning)
+    {
+        // hand the modified data over to the writer thread
+        Platform::Semaphore_Wait(Sema_FlushLock);
+
+        memcpy(&FlushBuffer[DirtyStart], &SRAM[DirtyStart], DirtyEnd-DirtyStart);
+        if (DirtyStart < FlushStart) FlushStart = DirtyStart;
+        if (DirtyEnd > FlushEnd) FlushEnd = DirtyEnd;
+
+        Platform::Semaphore_Post(Sema_FlushLock);
+        Platform::Semaphore_Post(Sema_FlushRequest);
+    }
+    else
+        WriteSaveRange(SRAM, SRAMLength, DirtyStart, DirtyEnd);
+
+    DirtyStart = 0xFFFFFFFF;
+    DirtyEnd = 0;
+}
+
+inline void SetDirty(u32 addr)
+{
+    if (addr < DirtyStart) DirtyStart = addr;
+    if (addr >= DirtyEnd) DirtyEnd = addr+1;
+}
+
+
 bool Init()
 {
     SRAM = NULL;
+    FlushThreadRunning = false;
+    FlushBuffer = NULL;
+    WriteBuffer = NULL;
     return true;
 }
 
 void DeInit()
 {
+    StopFlushThread();
     if (SRAM) delete[] SRAM;
 }
 
 void Reset()
 {
+    StopFlushThread();
     if (SRAM) delete[] SRAM;
     SRAM = NULL;
 }
@@ -102,6 +270,20 @@ void DoSavestate(Savestate* file)
         file->VarArray(SRAM, SRAMLength);
     }
 
+    if (!file->Saving)
+    {
+        if (SRAMLength != oldlen)
+            StartFlushThread();
+
+        // the whole save file needs to be rewritten on the next flush,
+        // which also truncates or extends it if the save length changed
+        if (SRAMLength)
+        {
+            DirtyStart = 0;
+            DirtyEnd = SRAMLength;
+        }
+    }
+
     // SPI status shito
 
     file->Var32(&Hold);
@@ -115,6 +297,7 @@ void DoSavestate(Savestate* file)
 
 void LoadSave(const char* path, u32 type)
 {
+    StopFlushThread();
     if (SRAM) delete[] SRAM;
 
     strncpy(SRAMPath, path, 1023);
@@ -167,6 +350,8 @@ void LoadSave(const char* path, u32 type)
     CurCmd = 0;
     Data = 0;
     StatusReg = 0x00;
+
+    StartFlushThread();
 }
 
 void RelocateSave(const char* path, bool write)
@@ -177,6 +362,10 @@ void RelocateSave(const char* path, bool write)
         return;
     }
 
+    // write out anything still pending to the old file
+    Flush();
+    StopFlushThread();
+
     strncpy(SRAMPath, path, 1023);
     SRAMPath[1023] = '\0';
 
@@ -184,11 +373,14 @@ void RelocateSave(const char* path, bool write)
     if (!f)
     {
         printf("NDSCart_SRAM::RelocateSave: failed to create new file. fuck\n");
+        StartFlushThread();
         return;
     }
 
     fwrite(SRAM, SRAMLength, 1, f);
     fclose(f);
+
+    StartFlushThread();
 }
 
 u8 Read()
@@ -211,7 +403,9 @@ void Write_EEPROMTiny(u8 val, bool islast)
         }
         else
         {
-            SRAM[(Addr + ((CurCmd==0x0A)?0x100:0)) & 0x1FF] = val;
+            u32 addr = (Addr + ((CurCmd==0x0A)?0x100:0)) & 0x1FF;
+            SRAM[addr] = val;
+            SetDirty(addr);
             Addr++;
         }
         break;
@@ -258,6 +452,7 @@ void Write_EEPROM(u8 val, bool islast)
         else
         {
             SRAM[Addr & (SRAMLength-1)] = val;
+            SetDirty(Addr & (SRAMLength-1));
             Addr++;
         }
         break;
@@ -301,6 +496,7 @@ void Write_Flash(u8 val, bool islast)
         else
         {
             SRAM[Addr & (SRAMLength-1)] = 0;
+            SetDirty(Addr & (SRAMLength-1));
             Addr++;
         }
         break;
@@ -329,6 +525,7 @@ void Write_Flash(u8 val, bool islast)
         else
         {
             SRAM[Addr & (SRAMLength-1)] = val;
+            SetDirty(Addr & (SRAMLength-1));
             Addr++;
         }
         break;
@@ -349,6 +546,7 @@ void Write_Flash(u8 val, bool islast)
             for (u32 i = 0; i < 0x10000; i++)
             {
                 SRAM[Addr & (SRAMLength-1)] = 0;
+                SetDirty(Addr & (SRAMLength-1));
                 Addr++;
             }
         }
@@ -366,6 +564,7 @@ void Write_Flash(u8 val, bool islast)
             for (u32 i = 0; i < 0x100; i++)
             {
                 SRAM[Addr & (SRAMLength-1)] = 0;
+                SetDirty(Addr & (SRAMLength-1));
                 Addr++;
             }
         }
@@ -445,15 +644,8 @@ void Write(u8 val, u32 hold)
         break;
     }
 
-    if (islast && (CurCmd == 0x02 || CurCmd == 0x0A) && (SRAMLength > 0))
-    {
-        FILE* f = Platform::OpenFile(SRAMPath, "wb");
-        if (f)
-        {
-            fwrite(SRAM, SRAMLength, 1, f);
-            fclose(f);
-        }
-    }
+    if (islast && (SRAMLength > 0))
+        Flush();
 }
 
 }
@@ -477,7 +669,22 @@ u8 TransferCmd[8];
 bool CartInserted;
 u8* CartROM;
 u32 CartROMSize;
+bool CartROMMapped;
 u32 CartCRC;
+bool CartCRCValid;
+
+// ROM areas modified after loading (secure area, DLDI driver), along with
+// their original contents, so the CRC is still that of the ROM as loaded
+struct ROMPatchArea
+{
+    u32 Offset;
+    u32 Length;
+    u8* Orig;
+};
+const int MaxROMPatchAreas = 4;
+ROMPatchArea ROMPatchAreas[MaxROMPatchAreas];
+int NumROMPatchAreas;
+
 u32 CartID;
 bool CartIsHomebrew;
 bool CartIsDSi;
@@ -499,6 +706,8 @@ void ROMCommand_Homebrew(u8* cmd);
 
 void (*ROMCommandHandler)(u8* cmd);
 
+void SaveROMPatchArea(u32 offset, u32 len);
+
 
 u32 ByteSwap(u32 val)
 {
@@ -612,15 +821,134 @@ void ApplyModcrypt(u32 addr, u32 len, u8* iv)
     u8 key[16];
 
     DSi_AES::GetModcryptKey(&CartROM[0], key);
+    SaveROMPatchArea(addr, len);
     DSi_AES::ApplyModcrypt(&CartROM[addr], len, key, iv);
 }
 
 
+bool AllocCartROM(const char* path, FILE* f, u32 len)
+{
+    // the ROM buffer is rounded up to a power of two, the area past the
+    // end of the file reads as zero
+#if !defined(_WIN32) && !defined(__SWITCH__)
+    // map the file copy-on-write instead of reading it. this way the ROM
+    // data is loaded on demand and shared with the page cache, only the
+    // pages we patch get a private copy
+    // (the file is opened again by path, as the FILE* may not be backed
+    // by a file descriptor)
+    int fd = open(path, O_RDONLY);
+    if (fd != -1)
+    {
+        u8* rom = (u8*)mmap(NULL, CartROMSize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+        if (rom != MAP_FAILED)
+        {
+            if (mmap(rom, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED)
+            {
+                close(fd);
+                CartROM = rom;
+                CartROMMapped = true;
+                return true;
+            }
+
+            munmap(rom, CartROMSize);
+        }
+
+        close(fd);
+    }
+#endif
+
+    CartROM = new u8[CartROMSize];
+    memset(CartROM, 0, CartROMSize);
+    fseek(f, 0, SEEK_SET);
+    if (fread(CartROM, 1, len, f) != len)
+    {
+        delete[] CartROM;
+        CartROM = NULL;
+        return false;
+    }
+
+    CartROMMapped = false;
+    return true;
+}
+
+void FreeCartROM()
+{
+    if (!CartROM) return;
+
+#if !defined(_WIN32) && !defined(__SWITCH__)
+    if (CartROMMapped)
+        munmap(CartROM, CartROMSize);
+    else
+#endif
+        delete[] CartROM;
+
+    CartROM = NULL;
+    CartROMMapped = false;
+}
+
+void SaveROMPatchArea(u32 offset, u32 len)
+{
+    // must be called before the area is modified
+    if (NumROMPatchAreas >= MaxROMPatchAreas) return;
+    if (offset >= CartROMSize) return;
+    if (len > CartROMSize - offset) len = CartROMSize - offset;
+
+    // keep the list sorted by offset
+    int i = NumROMPatchAreas++;
+    for (; i > 0 && ROMPatchAreas[i-1].Offset > offset; i--)
+        ROMPatchAreas[i] = ROMPatchAreas[i-1];
+
+    ROMPatchAreas[i].Offset = offset;
+    ROMPatchAreas[i].Length = len;
+    ROMPatchAreas[i].Orig = new u8[len];
+    memcpy(ROMPatchAreas[i].Orig, &CartROM[offset], len);
+}
+
+void FreeROMPatchAreas()
+{
+    for (int i = 0; i < NumROMPatchAreas; i++)
+        delete[] ROMPatchAreas[i].Orig;
+
+    NumROMPatchAreas = 0;
+}
+
+u32 GetCartCRC()
+{
+    if (!CartROM) return 0;
+
+    // computed on first use, as it requires going through the whole ROM.
+    // this is the CRC of the ROM as loaded, before it gets patched
+    if (!CartCRCValid)
+    {
+        u32 pos = 0;
+        CartCRC = 0;
+
+        for (int i = 0; i < NumROMPatchAreas; i++)
+        {
+            ROMPatchArea* area = &ROMPatchAreas[i];
+            if (area->Offset < pos) continue; // overlapping areas, shouldn't happen
+
+            CartCRC = CRC32(&CartROM[pos], area->Offset - pos, CartCRC);
+            CartCRC = CRC32(area->Orig, area->Length, CartCRC);
+            pos = area->Offset + area->Length;
+        }
+
+        CartCRC = CRC32(&CartROM[pos], CartROMSize - pos, CartCRC);
+
+        CartCRCValid = true;
+        printf("ROM CRC32: %08X\n", CartCRC);
+    }
+
+    return CartCRC;
+}
+
+
 bool Init()
 {
     if (!NDSCart_SRAM::Init()) return false;
 
     CartROM = NULL;
+    NumROMPatchAreas = 0;
 
     CartSD = NULL;
 
@@ -629,7 +957,8 @@ bool Init()
 
 void DeInit()
 {
-    if (CartROM) delete[] CartROM;
+    FreeCartROM();
+    FreeROMPatchAreas();
 
     if (CartSD) fclose(CartSD);
 
@@ -639,9 +968,10 @@ void DeInit()
 void Reset()
 {
     CartInserted = false;
-    if (CartROM) delete[] CartROM;
-    CartROM = NULL;
+    FreeCartROM();
     CartROMSize = 0;
+    CartCRCValid = false;
+    FreeROMPatchAreas();
     CartID = 0;
     CartIsHomebrew = false;
     CartIsDSi = false;
@@ -731,6 +1061,9 @@ void ApplyDLDIPatch(const u8* patch, u32 len)
     printf("existing driver is: %s\n", &binary[dldioffset+0x10]);
     printf("new driver is: %s\n", &patch[0x10]);
 
+    // the patch stays within the space allocated for the existing driver
+    SaveROMPatchArea(offset + dldioffset, std::max(len, 1u << binary[dldioffset+0x0F]));
+
     u32 memaddr = *(u32*)&binary[dldioffset+0x40];
     if (memaddr == 0)
         memaddr = *(u32*)&binary[dldioffset+0x68] - 0x80;
@@ -887,9 +1220,7 @@ void DecryptSecureArea(u8* out)
 
 bool LoadROM(const char* path, const char* sram, bool direct)
 {
-    // TODO: streaming mode? for really big ROMs or systems with limited RAM
-    // for now we're lazy
-    // also TODO: validate what we're loading!!
+    // TODO: validate what we're loading!!
 
     FILE* f = Platform::OpenFile(path, "rb");
     if (!f)
@@ -916,16 +1247,13 @@ bool LoadROM(const char* path, const char* sram, bool direct)
     fread(&unitcode, 1, 1, f);
     CartIsDSi = (unitcode & 0x02) != 0;
 
-    CartROM = new u8[CartROMSize];
-    memset(CartROM, 0, CartROMSize);
-    fseek(f, 0, SEEK_SET);
-    fread(CartROM, 1, len, f);
+    if (!AllocCartROM(path, f, len))
+    {
+        fclose(f);
+        return false;
+    }
 
     fclose(f);
-    //CartROM = f;
-
-    CartCRC = CRC32(CartROM, CartROMSize);
-    printf("ROM CRC32: %08X\n", CartCRC);
 
     ROMListEntry romparams;
     if (!ReadROMParams(gamecode, &romparams))
@@ -974,6 +1302,8 @@ bool LoadROM(const char* path, const char* sram, bool direct)
             {
                 printf("Re-encrypting cart secure area\n");
 
+                SaveROMPatchArea(arm9base, 0x800);
+
                 strncpy((char*)&CartROM[arm9base], "encryObj", 8);
 
                 Key1_InitKeycode(false, gamecode, 3, 2);
@@ -38,6 +38,8 @@ extern u32 CartROMSize;
 
 extern u32 CartID;
 
+u32 GetCartCRC();
+
 bool Init();
 void DeInit();
 void Reset();
@@ -80,6 +80,8 @@ inline bool LocalFileExists(const char* name)
 void* Thread_Create(void (*func)());
 void Thread_Free(void* thread);
 void Thread_Wait(void* thread);
+// suspends the calling thread
+void Thread_Sleep(u32 msecs);
 
 void* Semaphore_Create();
 void Semaphore_Free(void* sema);
@@ -91,10 +93,13 @@ void* GL_GetProcAddress(const char* proc);
 
 // local multiplayer comm interface
 // packet type: DS-style TX header (12 bytes) + original 802.11 frame
+// timestamp: emulated system time (NDS::SysTimestamp) at which the packet
+// is sent, or at which the receiver polls. frontends can use it to keep
+// instances in sync, or ignore it.
 bool MP_Init();
 void MP_DeInit();
-int MP_SendPacket(u8* data, int len);
-int MP_RecvPacket(u8* data, bool block);
+int MP_SendPacket(u8* data, int len, u64 timestamp);
+int MP_RecvPacket(u8* data, bool block, u64 timestamp);
 
 // LAN comm interface
 // packet type: Ethernet (802.3)
@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include "Config.h"
 #include "NDS.h"
 #include "DSi.h"
 #include "SPU.h"
@@ -61,7 +62,16 @@ const s16 PSGTable[8][8] =
     {-0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF, -0x7FFF}
 };
 
-const u32 kSamplesPerRun = 1;
+// samples are mixed in batches of up to kMaxSamplesPerRun, one Event_SPU per batch
+// any SPU register access first catches up with the samples that are due by then,
+// so the batch size doesn't affect what the channels see
+// (1 sample = 1024 system cycles)
+const u32 kMaxSamplesPerRun = 32;
+
+u64 MixTimestamp; // timestamp of the next sample to be mixed
+u32 MixPending;   // samples left in the current batch, the last one being at the Event_SPU timestamp
+
+void ScheduleMix();
 
 const u32 OutputBufferSize = 2*1024;
 s16 OutputBuffer[2 * OutputBufferSize];
@@ -111,7 +121,9 @@ void Reset()
     Capture[0]->Reset();
     Capture[1]->Reset();
 
-    NDS::ScheduleEvent(NDS::Event_SPU, true, 1024*kSamplesPerRun, Mix, kSamplesPerRun);
+    MixTimestamp = 1024;
+    MixPending = 0;
+    ScheduleMix();
 }
 
 void Stop()
@@ -135,6 +147,14 @@ void DoSavestate(Savestate* file)
 
     Capture[0]->DoSavestate(file);
     Capture[1]->DoSavestate(file);
+
+    if (!file->Saving)
+    {
+        // the batch state can be recovered from the scheduler
+        u64 evttime;
+        NDS::GetEvent(NDS::Event_SPU, &evttime, &MixPending);
+        MixTimestamp = evttime + 1024 - (MixPending << 10);
+    }
 }
 
 
@@ -602,7 +622,7 @@ void CaptureUnit::Run(s32 sample)
 }
 
 
-void Mix(u32 samples)
+void DoMix(u32 samples)
 {
     s32 channelbuf[32];
     s32 leftbuf[32], rightbuf[32];
@@ -764,8 +784,98 @@ void Mix(u32 samples)
             OutputReadOffset &= ((2*OutputBufferSize)-1);
         }
     }
+}
+
+void RunMix(u32 samples)
+{
+    while (samples > kMaxSamplesPerRun)
+    {
+        DoMix(kMaxSamplesPerRun);
+        samples -= kMaxSamplesPerRun;
+    }
+
+    if (samples)
+        DoMix(samples);
+}
+
+bool MixAccessesMemory()
+{
+    // sound capture writes to memory, and channels playing PCM/ADPCM data read from it
+    // memory accesses from the CPUs and DMA aren't synchronized with the mixer, so
+    // those have to be run sample by sample. PSG/noise only depend on SPU registers,
+    // which catch up the mix before they're accessed
+
+    if ((Capture[0]->Cnt | Capture[1]->Cnt) & (1<<7))
+        return true;
+
+    for (int i = 0; i < 16; i++)
+    {
+        u32 cnt = Channels[i]->Cnt;
+        if ((cnt & (1<<31)) && ((cnt >> 29) & 0x3) != 3)
+            return true;
+    }
+
+    return false;
+}
+
+void ScheduleMix()
+{
+    u32 samples;
+
+    if (MixAccessesMemory())
+        samples = 1;
+    else
+    {
+        samples = Config::SPU_BatchSize;
+        if      (samples < 1)                 samples = 1;
+        else if (samples > kMaxSamplesPerRun) samples = kMaxSamplesPerRun;
+    }
+
+    MixPending = samples;
+    NDS::ScheduleEvent(NDS::Event_SPU, true, 1024*samples, Mix, samples);
+}
+
+void Mix(u32 samples)
+{
+    // samples: what is left of the batch once CatchUp() had its way with it
+    RunMix(samples);
+    MixTimestamp += (samples << 10);
+
+    ScheduleMix();
+}
+
+void CatchUp()
+{
+    // mix the samples of the current batch that are due by the time of this ARM7 access
+
+    if (!MixPending) return;
+    if (NDS::ARM7Timestamp < MixTimestamp) return;
+
+    u32 due = ((NDS::ARM7Timestamp - MixTimestamp) >> 10) + 1;
+    if (due > MixPending) due = MixPending;
 
-    NDS::ScheduleEvent(NDS::Event_SPU, true, 1024*kSamplesPerRun, Mix, kSamplesPerRun);
+    RunMix(due);
+    MixTimestamp += (due << 10);
+    MixPending -= due;
+
+    // the rest of the batch still ends at the same timestamp
+    NDS::CancelEvent(NDS::Event_SPU);
+    NDS::ScheduleEvent(NDS::Event_SPU, true, 0, Mix, MixPending);
+}
+
+void UpdateBatch()
+{
+    // sound capture or a PCM/ADPCM channel was started: cut the current batch
+    // short, so that the mix sees memory just like it does sample by sample
+
+    if (MixPending <= 1) return;
+    if (!MixAccessesMemory()) return;
+
+    s32 delta = (MixPending - 1) << 10;
+    MixPending = 1;
+
+    NDS::CancelEvent(NDS::Event_SPU);
+    NDS::ScheduleEvent(NDS::Event_SPU, true, -delta, Mix, MixPending);
 }
 
 
@@ -851,6 +961,8 @@ int ReadOutput(s16* data, int samples)
 
 u8 Read8(u32 addr)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
@@ -881,6 +993,8 @@ u8 Read8(u32 addr)
 
 u16 Read16(u32 addr)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
@@ -908,6 +1022,8 @@ u16 Read16(u32 addr)
 
 u32 Read32(u32 addr)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
@@ -937,16 +1053,18 @@ u32 Read32(u32 addr)
 
 void Write8(u32 addr, u8 val)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
-        case 0x0: chan->SetCnt((chan->Cnt & 0xFFFFFF00) | val); return;
-        case 0x1: chan->SetCnt((chan->Cnt & 0xFFFF00FF) | (val << 8)); return;
-        case 0x2: chan->SetCnt((chan->Cnt & 0xFF00FFFF) | (val << 16)); return;
-        case 0x3: chan->SetCnt((chan->Cnt & 0x00FFFFFF) | (val << 24)); return;
+        case 0x0: chan->SetCnt((chan->Cnt & 0xFFFFFF00) | val); UpdateBatch(); return;
+        case 0x1: chan->SetCnt((chan->Cnt & 0xFFFF00FF) | (val << 8)); UpdateBatch(); return;
+        case 0x2: chan->SetCnt((chan->Cnt & 0xFF00FFFF) | (val << 16)); UpdateBatch(); return;
+        case 0x3: chan->SetCnt((chan->Cnt & 0x00FFFFFF) | (val << 24)); UpdateBatch(); return;
         }
     }
     else
@@ -965,10 +1083,12 @@ void Write8(u32 addr, u8 val)
         case 0x04000508:
             Capture[0]->SetCnt(val);
             if (val & 0x03) printf("!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
+            UpdateBatch();
             return;
         case 0x04000509:
             Capture[1]->SetCnt(val);
             if (val & 0x03) printf("!! UNSUPPORTED SPU CAPTURE MODE %02X\n", val);
+            UpdateBatch();
             return;
         }
     }
@@ -978,14 +1098,16 @@ void Write8(u32 addr, u8 val)
 
 void Write16(u32 addr, u16 val)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
-        case 0x0: chan->SetCnt((chan->Cnt & 0xFFFF0000) | val); return;
-        case 0x2: chan->SetCnt((chan->Cnt & 0x0000FFFF) | (val << 16)); return;
+        case 0x0: chan->SetCnt((chan->Cnt & 0xFFFF0000) | val); UpdateBatch(); return;
+        case 0x2: chan->SetCnt((chan->Cnt & 0x0000FFFF) | (val << 16)); UpdateBatch(); return;
         case 0x8:
             chan->SetTimerReload(val);
             if      ((addr & 0xF0) == 0x10) Capture[0]->SetTimerReload(val);
@@ -1015,6 +1137,7 @@ void Write16(u32 addr, u16 val)
             Capture[0]->SetCnt(val & 0xFF);
             Capture[1]->SetCnt(val >> 8);
             if (val & 0x0303) printf("!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
+            UpdateBatch();
             return;
 
         case 0x04000514: Capture[0]->SetLength(val); return;
@@ -1027,13 +1150,15 @@ void Write16(u32 addr, u16 val)
 
 void Write32(u32 addr, u32 val)
 {
+    CatchUp();
+
     if (addr < 0x04000500)
     {
         Channel* chan = Channels[(addr >> 4) & 0xF];
 
         switch (addr & 0xF)
         {
-        case 0x0: chan->SetCnt(val); return;
+        case 0x0: chan->SetCnt(val); UpdateBatch(); return;
         case 0x4: chan->SetSrcAddr(val); return;
         case 0x8:
             chan->SetLoopPos(val >> 16);
@@ -1063,6 +1188,7 @@ void Write32(u32 addr, u32 val)
             Capture[0]->SetCnt(val & 0xFF);
             Capture[1]->SetCnt(val >> 8);
             if (val & 0x0303) printf("!! UNSUPPORTED SPU CAPTURE MODE %04X\n", val);
+            UpdateBatch();
             return;
 
         case 0x04000510: Capture[0]->SetDstAddr(val); return;
@@ -17,17 +17,10 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "Savestate.h"
 #include "Platform.h"
 
-#ifdef __LIBRETRO__
-#define fclose(stream) memstream_close(stream)
-#define fread(data, len, count, stream) memstream_read(stream, data, len)
-#define fwrite(data, len, count, stream) memstream_write(stream, data, len)
-#define fseek(stream, offset, mask) memstream_seek(stream, offset, mask)
-#define ftell(stream) memstream_pos(stream)
-#endif
-
 /*
     Savestate format
 
@@ -51,11 +44,57 @@
     * different minor means adjustments may have to be made
 */
 
-#ifdef __LIBRETRO__
-Savestate::Savestate(void *data, size_t size, bool save)
-#else
+#ifndef __LIBRETRO__
 Savestate::Savestate(const char* filename, bool save)
+{
+    Buffer = nullptr;
+    BufferSize = 0;
+    Pos = 0;
+    Length = 0;
+    Measuring = false;
+
+    file = Platform::OpenFile(filename, save ? "wb" : "rb");
+    if (!file)
+    {
+        printf("savestate: file %s doesn't exist\n", filename);
+        Error = true;
+        Saving = save;
+        return;
+    }
+
+    Init(save);
+}
+#endif
+
+Savestate::Savestate(void* data, u32 size, bool save)
+{
+#ifndef __LIBRETRO__
+    file = nullptr;
+#endif
+    Buffer = (u8*)data;
+    BufferSize = size;
+    Pos = 0;
+    Length = save ? 0 : size;
+    Measuring = false;
+
+    Init(save);
+}
+
+Savestate::Savestate()
+{
+#ifndef __LIBRETRO__
+    file = nullptr;
 #endif
+    Buffer = nullptr;
+    BufferSize = 0;
+    Pos = 0;
+    Length = 0;
+    Measuring = true;
+
+    Init(true);
+}
+
+void Savestate::Init(bool save)
 {
     const char* magic = "MELN";
 
@@ -64,63 +103,24 @@ Savestate::Savestate(const char* filename, bool save)
     if (save)
     {
         Saving = true;
-#ifdef __LIBRETRO__
-        memstream_set_buffer((uint8_t*)data, size);
-        file = memstream_open(true);
-        if (file == NULL)
-        {
-            printf("unable to create memstream for savestate\n");
-            Error = true;
-            return;
-        }
-#else
-        file = Platform::OpenFile(filename, "wb");
-        if (!file)
-        {
-            printf("savestate: file %s doesn't exist\n", filename);
-            Error = true;
-            return;
-        }
-#endif
 
         VersionMajor = SAVESTATE_MAJOR;
         VersionMinor = SAVESTATE_MINOR;
 
-        fwrite(magic, 4, 1, file);
-        fwrite(&VersionMajor, 2, 1, file);
-        fwrite(&VersionMinor, 2, 1, file);
-        fseek(file, 8, SEEK_CUR); // length to be fixed later
+        Write(magic, 4);
+        Write(&VersionMajor, 2);
+        Write(&VersionMinor, 2);
+        Seek(Tell() + 8); // length to be fixed later
     }
     else
     {
         Saving = false;
-#ifdef __LIBRETRO__
-        memstream_set_buffer((uint8_t*)data, size);
-        file = memstream_open(false);
-        if (file == NULL)
-        {
-            printf("unable to create memstream for savestate\n");
-            Error = true;
-            return;
-        }
-#else
-        file = Platform::OpenFile(filename, "rb");
-        if (!file)
-        {
-            printf("savestate: file %s doesn't exist\n", filename);
-            Error = true;
-            return;
-        }
-#endif
 
-        u32 len;
-        fseek(file, 0, SEEK_END);
-        len = (u32)ftell(file);
-        fseek(file, 0, SEEK_SET);
+        u32 len = GetLength();
 
         u32 buf = 0;
 
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != ((u32*)magic)[0])
         {
             printf("savestate: invalid magic %08X\n", buf);
@@ -131,7 +131,7 @@ Savestate::Savestate(const char* filename, bool save)
         VersionMajor = 0;
         VersionMinor = 0;
 
-        fread(&VersionMajor, 2, 1, file);
+        Read(&VersionMajor, 2);
         if (VersionMajor != SAVESTATE_MAJOR)
         {
             printf("savestate: bad version major %d, expecting %d\n", VersionMajor, SAVESTATE_MAJOR);
@@ -139,7 +139,7 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        fread(&VersionMinor, 2, 1, file);
+        Read(&VersionMinor, 2);
         if (VersionMinor > SAVESTATE_MINOR)
         {
             printf("savestate: state from the future, %d > %d\n", VersionMinor, SAVESTATE_MINOR);
@@ -148,7 +148,7 @@ Savestate::Savestate(const char* filename, bool save)
         }
 
         buf = 0;
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != len)
         {
             printf("savestate: bad length %d\n", buf);
@@ -156,7 +156,7 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        fseek(file, 4, SEEK_CUR);
+        Seek(Tell() + 4);
     }
 
     CurSection = -1;
@@ -164,28 +164,122 @@ Savestate::Savestate(const char* filename, bool save)
 
 Savestate::~Savestate()
 {
-    if (Error) return;
-
-    if (Saving)
+    if (!Error && Saving)
     {
         if (CurSection != -1)
         {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+            u32 pos = Tell();
+            Seek(CurSection+4);
 
             u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+            Write(&len, 4);
+
+            Seek(pos);
+        }
+
+        u32 len = GetLength();
+        Seek(8);
+        Write(&len, 4);
+    }
+
+#ifndef __LIBRETRO__
+    if (file) fclose(file);
+#endif
+}
 
-            fseek(file, pos, SEEK_SET);
+void Savestate::Read(void* data, u32 len)
+{
+#ifndef __LIBRETRO__
+    if (file)
+    {
+        fread(data, len, 1, file);
+        return;
+    }
+#endif
+
+    // like fread, reading past the end leaves the remaining data untouched
+    if (Pos >= Length) return;
+    u32 avail = Length - Pos;
+    if (len > avail) len = avail;
+
+    memcpy(data, &Buffer[Pos], len);
+    Pos += len;
+}
+
+void Savestate::Write(const void* data, u32 len)
+{
+#ifndef __LIBRETRO__
+    if (file)
+    {
+        fwrite(data, len, 1, file);
+        return;
+    }
+#endif
+
+    if (!Measuring)
+    {
+        if (Pos + len > BufferSize)
+        {
+            printf("savestate: buffer too small (%d bytes)\n", BufferSize);
+            Error = true;
+            return;
+        }
+
+        memcpy(&Buffer[Pos], data, len);
+    }
+
+    Pos += len;
+    if (Pos > Length) Length = Pos;
+}
+
+void Savestate::Seek(u32 pos)
+{
+#ifndef __LIBRETRO__
+    if (file)
+    {
+        fseek(file, pos, SEEK_SET);
+        return;
+    }
+#endif
+
+    Pos = pos;
+    // seeking past the end while saving extends the savestate, like with files
+    if (Saving && Pos > Length)
+    {
+        if (!Measuring && Pos > BufferSize)
+        {
+            printf("savestate: buffer too small (%d bytes)\n", BufferSize);
+            Error = true;
+            return;
         }
 
+        if (!Measuring) memset(&Buffer[Length], 0, Pos - Length);
+        Length = Pos;
+    }
+}
+
+u32 Savestate::Tell()
+{
+#ifndef __LIBRETRO__
+    if (file) return (u32)ftell(file);
+#endif
+    return Pos;
+}
+
+u32 Savestate::GetLength()
+{
+#ifndef __LIBRETRO__
+    if (file)
+    {
+        u32 pos = (u32)ftell(file);
         fseek(file, 0, SEEK_END);
         u32 len = (u32)ftell(file);
-        fseek(file, 8, SEEK_SET);
-        fwrite(&len, 4, 1, file);
+        fseek(file, pos, SEEK_SET);
+        return len;
     }
+#endif
 
-    if (file) fclose(file);
+    return Length;
 }
 
 void Savestate::Section(const char* magic)
@@ -196,29 +290,29 @@ void Savestate::Section(const char* magic)
     {
         if (CurSection != -1)
         {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+            u32 pos = Tell();
+            Seek(CurSection+4);
 
             u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+            Write(&len, 4);
 
-            fseek(file, pos, SEEK_SET);
+            Seek(pos);
         }
 
-        CurSection = (u32)ftell(file);
+        CurSection = Tell();
 
-        fwrite(magic, 4, 1, file);
-        fseek(file, 12, SEEK_CUR);
+        Write(magic, 4);
+        Seek(Tell() + 12);
     }
     else
     {
-        fseek(file, 0x10, SEEK_SET);
+        Seek(0x10);
 
         for (;;)
         {
             u32 buf = 0;
 
-            fread(&buf, 4, 1, file);
+            Read(&buf, 4);
             if (buf != ((u32*)magic)[0])
             {
                 if (buf == 0)
@@ -228,28 +322,27 @@ void Savestate::Section(const char* magic)
                 }
 
                 buf = 0;
-                fread(&buf, 4, 1, file);
-                fseek(file, buf-8, SEEK_CUR);
+                Read(&buf, 4);
+                Seek(Tell() + buf-8);
                 continue;
             }
 
-            fseek(file, 12, SEEK_CUR);
+            Seek(Tell() + 12);
             break;
         }
     }
 }
-
 void Savestate::Var8(u8* var)
 {
     if (Error) return;
 
     if (Saving)
     {
-        fwrite(var, 1, 1, file);
+        Write(var, 1);
     }
     else
     {
-        fread(var, 1, 1, file);
+        Read(var, 1);
     }
 }
 
@@ -259,11 +352,11 @@ void Savestate::Var16(u16* var)
 
     if (Saving)
     {
-        fwrite(var, 2, 1, file);
+        Write(var, 2);
     }
     else
     {
-        fread(var, 2, 1, file);
+        Read(var, 2);
     }
 }
 
@@ -273,11 +366,11 @@ void Savestate::Var32(u32* var)
 
     if (Saving)
     {
-        fwrite(var, 4, 1, file);
+        Write(var, 4);
     }
     else
     {
-        fread(var, 4, 1, file);
+        Read(var, 4);
     }
 }
 
@@ -287,11 +380,11 @@ void Savestate::Var64(u64* var)
 
     if (Saving)
     {
-        fwrite(var, 8, 1, file);
+        Write(var, 8);
     }
     else
     {
-        fread(var, 8, 1, file);
+        Read(var, 8);
     }
 }
 
@@ -317,10 +410,10 @@ void Savestate::VarArray(void* data, u32 len)
 
     if (Saving)
     {
-        fwrite(data, len, 1, file);
+        Write(data, len);
     }
     else
     {
-        fread(data, len, 1, file);
+        Read(data, len);
     }
 }
\ No newline at end of file
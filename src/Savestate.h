@@ -23,20 +23,18 @@
 #include "types.h"
 
 #define SAVESTATE_MAJOR 6
-#define SAVESTATE_MINOR 0
-
-#ifdef __LIBRETRO__
-#include <streams/memory_stream.h>
-#endif
+#define SAVESTATE_MINOR 1
 
 class Savestate
 {
 public:
-#ifdef __LIBRETRO__
-    Savestate(void *data, size_t size, bool save);
-#else
+#ifndef __LIBRETRO__
     Savestate(const char* filename, bool save);
 #endif
+    // in-memory savestate, read from or written directly to the given buffer
+    Savestate(void* data, u32 size, bool save);
+    // dry-run save that only measures the resulting savestate size
+    Savestate();
     ~Savestate();
 
     bool Error;
@@ -65,19 +63,28 @@ public:
         return false;
     }
 
-#ifdef __LIBRETRO__
-    uint64_t GetOffset()
-    {
-        return memstream_pos(file);
-    }
-#endif
+    u32 GetOffset() { return Tell(); }
 
 private:
-#ifdef __LIBRETRO__
-    memstream_t* file;
-#else
+#ifndef __LIBRETRO__
     FILE* file;
 #endif
+
+    // buffer backend, used when file is NULL
+    // when measuring, Buffer is NULL and only Pos/Length are updated
+    u8* Buffer;
+    u32 BufferSize;
+    u32 Pos;
+    u32 Length;
+    bool Measuring;
+
+    void Init(bool save);
+
+    void Read(void* data, u32 len);
+    void Write(const void* data, u32 len);
+    void Seek(u32 pos);
+    u32 Tell();
+    u32 GetLength();
 };
 
 #endif // SAVESTATE_H
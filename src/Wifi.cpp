@@ -81,6 +81,17 @@ u32 RXCounter;
 int MPReplyTimer;
 int MPNumReplies;
 
+// while the hardware is idle, the µs ticks up to the next one that has
+// something to do are skipped, and the counters are caught up lazily
+// USIdleStart: timestamp of the last tick that actually ran
+// USIdleRun: number of ticks skipped after it
+// USIdleDone: number of those ticks already applied to the counters
+u64 USIdleStart;
+u32 USIdleRun;
+u32 USIdleDone;
+
+void CatchUpIdleTicks();
+
 bool MPInited;
 bool LANInited;
 
@@ -212,6 +223,10 @@ void Reset()
 
     CmdCounter = 0;
 
+    USIdleStart = 0;
+    USIdleRun = 0;
+    USIdleDone = 0;
+
     WifiAP::Reset();
 }
 
@@ -219,6 +234,9 @@ void DoSavestate(Savestate* file)
 {
     file->Section("WIFI");
 
+    if (file->Saving)
+        CatchUpIdleTicks();
+
     // berp.
     // not sure we're saving enough shit at all there.
     // also: savestate and wifi can't fucking work together!!
@@ -247,6 +265,20 @@ void DoSavestate(Savestate* file)
     file->Var32((u32*)&MPNumReplies);
 
     file->Var32(&CmdCounter);
+
+    if (!file->Saving)
+    {
+        // the idle tick window isn't saved: restart regular ticking
+        // from the restored counters
+        USIdleRun = 0;
+        USIdleDone = 0;
+
+        if (!(IOPORT(W_PowerUS) & 0x0001))
+        {
+            NDS::CancelEvent(NDS::Event_Wifi);
+            NDS::ScheduleEvent(NDS::Event_Wifi, false, 33, USTimer, 0);
+        }
+    }
 }
 
 
@@ -501,7 +533,7 @@ void SendMPDefaultReply()
 	*(u16*)&reply[0xC + 0x16] = IOPORT(W_TXSeqNo) << 4;
 	*(u32*)&reply[0xC + 0x18] = 0;
 
-	int txlen = Platform::MP_SendPacket(reply, 12+28);
+	int txlen = Platform::MP_SendPacket(reply, 12+28, NDS::SysTimestamp);
 	WIFI_LOG("wifi: sent %d/40 bytes of MP default reply\n", txlen);
 }
 
@@ -531,7 +563,7 @@ void SendMPAck()
 	*(u16*)&ack[0xC + 0x1A] = 0;
 	*(u32*)&ack[0xC + 0x1C] = 0;
 
-	int txlen = Platform::MP_SendPacket(ack, 12+32);
+	int txlen = Platform::MP_SendPacket(ack, 12+32, NDS::SysTimestamp);
 	WIFI_LOG("wifi: sent %d/44 bytes of MP ack, %d %d\n", txlen, ComStatus, RXTime);
 }
 
@@ -656,7 +688,7 @@ bool ProcessTX(TXSlot* slot, int num)
             IOPORT(W_RXTXAddr) = slot->Addr >> 1;
 
             // send
-            int txlen = Platform::MP_SendPacket(&RAM[slot->Addr], 12 + slot->Length);
+            int txlen = Platform::MP_SendPacket(&RAM[slot->Addr], 12 + slot->Length, NDS::SysTimestamp);
             WIFI_LOG("wifi: sent %d/%d bytes of slot%d packet, addr=%04X, framectl=%04X, %04X %04X\n",
                      txlen, slot->Length+12, num, slot->Addr, *(u16*)&RAM[slot->Addr + 0xC],
                      *(u16*)&RAM[slot->Addr + 0x24], *(u16*)&RAM[slot->Addr + 0x26]);
@@ -827,7 +859,7 @@ bool CheckRX(bool block)
 
     for (;;)
     {
-        int rxlen = Platform::MP_RecvPacket(RXBuffer, block);
+        int rxlen = Platform::MP_RecvPacket(RXBuffer, block, NDS::SysTimestamp);
         if (rxlen == 0) rxlen = WifiAP::RecvPacket(RXBuffer);
         if (rxlen == 0) return false;
         if (rxlen < 12+24) continue;
@@ -969,9 +1001,97 @@ void MSTimer()
     }
 }
 
+void RunIdleTicks(u32 num)
+{
+    // equivalent to running USTimer() num times, provided none of these
+    // ticks would poll for RX, start a TX, or hit a ms/pre-beacon point
+
+    WifiAP::USTimer(num);
+
+    if (IOPORT(W_USCountCnt))
+        USCounter += num;
+
+    if (IOPORT(W_CmdCountCnt) & 0x0001)
+        CmdCounter = (CmdCounter > num) ? (CmdCounter - num) : 0;
+
+    if (IOPORT(W_ContentFree) > num)
+        IOPORT(W_ContentFree) -= num;
+    else
+        IOPORT(W_ContentFree) = 0;
+
+    RXCounter += num;
+}
+
+u32 GetIdleTicks()
+{
+    // how many of the upcoming ticks can be skipped
+
+    if (ComStatus != 0 || IOPORT(W_TXBusy) != 0)
+        return 0;
+
+    u32 rxpos = RXCounter & 0x1FF;
+    if (!rxpos) return 0;
+    u32 num = 0x200 - rxpos;
+
+    if (IOPORT(W_USCountCnt))
+    {
+        u32 uspart = USCounter & 0x3FF;
+        if (num > 0x3FF - uspart)
+            num = 0x3FF - uspart;
+
+        if (IOPORT(W_USCompareCnt))
+        {
+            u32 prebeacon = IOPORT(W_PreBeacon);
+            if ((prebeacon >> 10) == IOPORT(W_BeaconCount1))
+            {
+                u32 target = 0x3FF - (prebeacon & 0x3FF);
+                if (target > uspart && num > target - uspart - 1)
+                    num = target - uspart - 1;
+            }
+        }
+    }
+
+    return num;
+}
+
+void CatchUpIdleTicks()
+{
+    if (USIdleDone >= USIdleRun)
+        return;
+
+    u64 now = (NDS::CurCPU == 0) ? (NDS::ARM9Timestamp >> NDS::ARM9ClockShift) : NDS::ARM7Timestamp;
+    if (now <= USIdleStart)
+        return;
+
+    u64 elapsed = (now - USIdleStart) / 33;
+    if (elapsed > USIdleRun) elapsed = USIdleRun;
+    if (elapsed <= USIdleDone)
+        return;
+
+    RunIdleTicks(elapsed - USIdleDone);
+    USIdleDone = elapsed;
+}
+
+void EndIdleTicks()
+{
+    // a register write may change what the next ticks have to do:
+    // bring the timer event back to the next tick
+
+    CatchUpIdleTicks();
+    if (USIdleDone >= USIdleRun)
+        return;
+
+    NDS::CancelEvent(NDS::Event_Wifi);
+    NDS::ScheduleEvent(NDS::Event_Wifi, true, -33 * (s32)(USIdleRun - USIdleDone), USTimer, 0);
+    USIdleRun = USIdleDone;
+}
+
 void USTimer(u32 param)
 {
-    WifiAP::USTimer();
+    if (USIdleRun > USIdleDone)
+        RunIdleTicks(USIdleRun - USIdleDone);
+
+    WifiAP::USTimer(1);
 
     if (IOPORT(W_USCountCnt))
     {
@@ -1106,9 +1226,16 @@ void USTimer(u32 param)
         }
     }
 
+    u64 timestamp; u32 dummy;
+    NDS::GetEvent(NDS::Event_Wifi, &timestamp, &dummy);
+
+    USIdleStart = timestamp;
+    USIdleRun = GetIdleTicks();
+    USIdleDone = 0;
+
     // TODO: make it more accurate, eventually
     // in the DS, the wifi system has its own 22MHz clock and doesn't use the system clock
-    NDS::ScheduleEvent(NDS::Event_Wifi, true, 33, USTimer, 0);
+    NDS::ScheduleEvent(NDS::Event_Wifi, true, 33 * (USIdleRun + 1), USTimer, 0);
 }
 
 
@@ -1164,6 +1291,8 @@ u16 Read(u32 addr)
 
     bool activeread = (addr < 0x1000);
 
+    CatchUpIdleTicks();
+
     switch (addr)
     {
     case W_Random: // random generator. not accurate
@@ -1253,6 +1382,8 @@ void Write(u32 addr, u16 val)
     if (addr >= 0x2000 && addr < 0x4000)
         return;
 
+    EndIdleTicks();
+
     switch (addr)
     {
     case W_ModeReset:
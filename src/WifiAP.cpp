@@ -115,12 +115,12 @@ bool MACIsBroadcast(u8* a)
 }
 
 
-void USTimer()
+void USTimer(u32 num)
 {
-    USCounter++;
+    u64 oldcount = USCounter;
+    USCounter += num;
 
-    u32 chk = (u32)USCounter;
-    if (!(chk & 0x1FFFF))
+    if ((oldcount >> 17) != (USCounter >> 17))
     {
         // send beacon every 128ms
         BeaconDue = true;
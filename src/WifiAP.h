@@ -31,7 +31,7 @@ bool Init();
 void DeInit();
 void Reset();
 
-void USTimer();
+void USTimer(u32 num);
 void MSTimer();
 
 // packet format: 12-byte TX header + original 802.11 frame
@@ -0,0 +1,536 @@
+/*
+    Copyright 2016-2020 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <QSharedMemory>
+#include <QCoreApplication>
+#include <QThread>
+#include <QElapsedTimer>
+
+#ifdef __linux__
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "LocalMP.h"
+
+
+namespace LocalMP
+{
+
+// the shared memory block is a header, a table of peers, then a ring of
+// packet slots.
+// senders claim a slot by bumping WriteClaim, fill it, then tag it with its
+// sequence number + 1. every instance keeps its own read sequence number,
+// so there is no shared read cursor and no lock anywhere.
+// a slot being rewritten has its tag cleared first; readers check the tag
+// again after copying the packet, and drop it if it changed in the meantime.
+//
+// sync mode works like a conservative parallel discrete event simulation:
+// * every instance publishes its emulated time in the peer table whenever
+//   it sends or polls, promising it won't send anything older than that
+// * a packet sent at time T is delivered at T + kLookahead
+// * before polling at time R, an instance waits until every peer is past
+//   R - kLookahead. all packets due by R have then been sent already, so
+//   what gets received never depends on host timing.
+
+const u32 kMagic = 0x504D4C4D; // MLMP
+const u32 kVersion = 2;
+
+const u32 kNumSlots = 256; // must be a power of two
+const u32 kMaxPacketLen = 2048;
+const int kMaxPeers = 16;
+
+// in ARM7 cycles (64us)
+const u64 kLookahead = 33 * 64;
+
+// a peer whose time doesn't move for this long (wifi off, paused, crashed)
+// doesn't hold the others back
+const int kPeerStallTimeout = 1000;
+
+struct SlotHeader
+{
+    std::atomic<u32> Tag;
+    u32 SenderID;
+    u32 Length;
+    u32 Pad;
+    u64 Time; // delivery time, sync mode only
+};
+
+struct Slot
+{
+    SlotHeader Header;
+    u8 Data[kMaxPacketLen];
+};
+
+struct QueueHeader
+{
+    std::atomic<u32> Magic;
+    u32 Version;
+
+    std::atomic<u32> WriteClaim;
+    // bumped after every packet, waited on by blocking receivers
+    std::atomic<u32> Published;
+    // bumped whenever a peer time changes, waited on in sync mode
+    std::atomic<u32> SyncSeq;
+    std::atomic<u32> Waiters;
+
+    u32 Pad[10];
+};
+
+struct PeerState
+{
+    std::atomic<u32> ID; // 0 = free
+    u32 Pad;
+    std::atomic<u64> Time; // sync time + 1, 0 = not started yet
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory queue requires lock-free atomics");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory queue requires lock-free atomics");
+static_assert(sizeof(QueueHeader) == 64, "bad QueueHeader size");
+
+QSharedMemory* SharedMem = nullptr;
+QueueHeader* Header = nullptr;
+PeerState* Peers = nullptr;
+Slot* Slots = nullptr;
+
+u32 InstanceID;
+u32 ReadSeq;
+
+bool SyncMode;
+int PeerIndex;
+bool TimeBaseSet;
+u64 TimeOffset;
+u64 LastTimestamp;
+u32 DeliveredSeq[kNumSlots];
+u64 PeerLastTime[kMaxPeers];
+qint64 PeerLastChange[kMaxPeers];
+QElapsedTimer Clock;
+
+
+void WaitOnWord(std::atomic<u32>* word, u32 val, int timeout_us)
+{
+    Header->Waiters.fetch_add(1);
+
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+    // the futex is shared between processes, so no FUTEX_PRIVATE_FLAG here
+    syscall(SYS_futex, (u32*)word, FUTEX_WAIT, val, &ts, nullptr, 0);
+#else
+    // no cross-process address wait available, poll instead
+    QElapsedTimer timer;
+    timer.start();
+    while (word->load() == val && timer.nsecsElapsed() < timeout_us * 1000LL)
+        QThread::usleep(50);
+#endif
+
+    Header->Waiters.fetch_sub(1);
+}
+
+void WakeWord(std::atomic<u32>* word)
+{
+#ifdef __linux__
+    if (Header->Waiters.load() != 0)
+        syscall(SYS_futex, (u32*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+
+bool Init(bool sync)
+{
+    const int size = sizeof(QueueHeader) + kMaxPeers * sizeof(PeerState) + kNumSlots * sizeof(Slot);
+
+    SharedMem = new QSharedMemory("melonNIFI");
+    bool created = SharedMem->create(size);
+    if (!created)
+    {
+        if (SharedMem->error() != QSharedMemory::AlreadyExists || !SharedMem->attach())
+        {
+            printf("LocalMP: could not create or attach shared memory: %s\n",
+                   SharedMem->errorString().toUtf8().constData());
+            delete SharedMem;
+            SharedMem = nullptr;
+            return false;
+        }
+    }
+
+    if (SharedMem->size() < size)
+    {
+        printf("LocalMP: shared memory too small (%d < %d)\n", SharedMem->size(), size);
+        DeInit();
+        return false;
+    }
+
+    Header = (QueueHeader*)SharedMem->data();
+    Peers = (PeerState*)&Header[1];
+    Slots = (Slot*)&Peers[kMaxPeers];
+
+    if (created)
+    {
+        memset(SharedMem->data(), 0, size);
+        Header->Version = kVersion;
+        Header->Magic.store(kMagic, std::memory_order_release);
+    }
+    else
+    {
+        // give the creating instance some time to set up the header
+        QElapsedTimer timer;
+        timer.start();
+        while (Header->Magic.load(std::memory_order_acquire) != kMagic)
+        {
+            if (timer.elapsed() > 1000)
+            {
+                printf("LocalMP: shared memory was never initialized\n");
+                DeInit();
+                return false;
+            }
+            QThread::usleep(100);
+        }
+
+        if (Header->Version != kVersion)
+        {
+            printf("LocalMP: shared memory version mismatch (%d, expected %d)\n", Header->Version, kVersion);
+            DeInit();
+            return false;
+        }
+    }
+
+    InstanceID = (u32)QCoreApplication::applicationPid();
+    ReadSeq = Header->WriteClaim.load();
+
+    SyncMode = sync;
+    PeerIndex = -1;
+    TimeBaseSet = false;
+    TimeOffset = 0;
+    LastTimestamp = 0;
+    memset(DeliveredSeq, 0, sizeof(DeliveredSeq));
+    memset(PeerLastTime, 0, sizeof(PeerLastTime));
+    memset(PeerLastChange, 0, sizeof(PeerLastChange));
+    Clock.start();
+
+    return true;
+}
+
+void DeInit()
+{
+    if (Header && PeerIndex != -1)
+    {
+        Peers[PeerIndex].Time.store(0);
+        Peers[PeerIndex].ID.store(0);
+        PeerIndex = -1;
+
+        // let waiting peers notice we're gone
+        Header->SyncSeq.fetch_add(1);
+        WakeWord(&Header->SyncSeq);
+    }
+
+    if (SharedMem)
+    {
+        SharedMem->detach();
+        delete SharedMem;
+        SharedMem = nullptr;
+    }
+
+    Header = nullptr;
+    Peers = nullptr;
+    Slots = nullptr;
+}
+
+
+u64 SyncTime(u64 timestamp)
+{
+    // each instance has its own timestamps, they are translated to a common
+    // time base. an instance joins at the time of the most advanced peer,
+    // and going back in time (reset, savestate) keeps the shared time going.
+
+    if (!TimeBaseSet)
+    {
+        u64 maxtime = 0;
+        for (int i = 0; i < kMaxPeers; i++)
+        {
+            if (i == PeerIndex || Peers[i].ID.load() == 0) continue;
+
+            u64 t = Peers[i].Time.load();
+            if (t > maxtime) maxtime = t;
+        }
+
+        TimeOffset = maxtime ? (maxtime - 1 - timestamp) : 0;
+        TimeBaseSet = true;
+    }
+    else if (timestamp < LastTimestamp)
+    {
+        TimeOffset += LastTimestamp - timestamp;
+    }
+
+    LastTimestamp = timestamp;
+    return timestamp + TimeOffset;
+}
+
+void PublishTime(u64 synctime)
+{
+    if (PeerIndex == -1)
+    {
+        for (int i = 0; i < kMaxPeers; i++)
+        {
+            u32 expected = 0;
+            if (Peers[i].ID.compare_exchange_strong(expected, InstanceID))
+            {
+                PeerIndex = i;
+                break;
+            }
+        }
+
+        if (PeerIndex == -1)
+        {
+            printf("LocalMP: too many instances, sync disabled\n");
+            SyncMode = false;
+            return;
+        }
+    }
+
+    Peers[PeerIndex].Time.store(synctime + 1);
+    Header->SyncSeq.fetch_add(1);
+    WakeWord(&Header->SyncSeq);
+}
+
+void WaitForPeers(u64 synctime)
+{
+    for (;;)
+    {
+        u32 seq = Header->SyncSeq.load();
+        qint64 now = Clock.elapsed();
+
+        bool behind = false;
+        for (int i = 0; i < kMaxPeers; i++)
+        {
+            if (i == PeerIndex || Peers[i].ID.load() == 0) continue;
+
+            u64 t = Peers[i].Time.load();
+            if (t == 0) continue;
+
+            if (t != PeerLastTime[i])
+            {
+                PeerLastTime[i] = t;
+                PeerLastChange[i] = now;
+            }
+            else if ((now - PeerLastChange[i]) > kPeerStallTimeout)
+                continue;
+
+            // peer is at t-1, it must be past synctime - kLookahead
+            if ((t - 1) + kLookahead <= synctime)
+            {
+                behind = true;
+                break;
+            }
+        }
+
+        if (!behind)
+            return;
+
+        WaitOnWord(&Header->SyncSeq, seq, 100000);
+    }
+}
+
+
+int SendPacket(u8* data, int len, u64 timestamp)
+{
+    if (!Header)
+        return 0;
+
+    if (len > (int)kMaxPacketLen)
+    {
+        printf("LocalMP::SendPacket: error: packet too long (%d)\n", len);
+        return 0;
+    }
+
+    u64 synctime = SyncMode ? SyncTime(timestamp) : 0;
+
+    u32 seq = Header->WriteClaim.fetch_add(1);
+    Slot* slot = &Slots[seq & (kNumSlots-1)];
+
+    slot->Header.Tag.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->Header.SenderID = InstanceID;
+    slot->Header.Length = len;
+    slot->Header.Time = synctime + kLookahead;
+    memcpy(slot->Data, data, len);
+
+    slot->Header.Tag.store(seq + 1, std::memory_order_release);
+
+    Header->Published.fetch_add(1);
+    WakeWord(&Header->Published);
+
+    if (SyncMode)
+        PublishTime(synctime);
+
+    return len;
+}
+
+int RecvPacketSync(u8* data, u64 timestamp)
+{
+    u64 synctime = SyncTime(timestamp);
+
+    PublishTime(synctime);
+    if (!SyncMode) return 0;
+    WaitForPeers(synctime);
+
+    u32 claimed = Header->WriteClaim.load();
+    if ((claimed - ReadSeq) > kNumSlots)
+        ReadSeq = claimed - kNumSlots;
+
+    // everything due by now has been sent. pick the oldest of those, with
+    // the sender MAC as tie breaker, so the order doesn't depend on the order
+    // in which the host ran the instances
+
+    for (;;)
+    {
+        u32 best = 0;
+        bool found = false;
+        u64 besttime = 0;
+        u8 bestmac[6];
+
+        for (u32 seq = ReadSeq; seq != claimed; seq++)
+        {
+            if (DeliveredSeq[seq & (kNumSlots-1)] == seq + 1) continue;
+
+            Slot* slot = &Slots[seq & (kNumSlots-1)];
+            if (slot->Header.Tag.load(std::memory_order_acquire) != seq + 1) continue;
+            if (slot->Header.SenderID == InstanceID) continue;
+
+            u64 time = slot->Header.Time;
+            if (time > synctime) continue;
+
+            u8 mac[6] = {0};
+            if (slot->Header.Length >= 12+16)
+                memcpy(mac, &slot->Data[12+10], 6);
+
+            if (!found || time < besttime || (time == besttime && memcmp(mac, bestmac, 6) < 0))
+            {
+                best = seq;
+                besttime = time;
+                memcpy(bestmac, mac, 6);
+                found = true;
+            }
+        }
+
+        if (!found)
+            break;
+
+        Slot* slot = &Slots[best & (kNumSlots-1)];
+        u32 len = slot->Header.Length;
+        if (len > kMaxPacketLen) len = 0;
+        memcpy(data, slot->Data, len);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool torn = slot->Header.Tag.load(std::memory_order_relaxed) != best + 1;
+
+        DeliveredSeq[best & (kNumSlots-1)] = best + 1;
+
+        if (torn || len < 24)
+            continue;
+
+        return len;
+    }
+
+    // move past everything that was delivered, sent by us, or overwritten
+    while (ReadSeq != claimed)
+    {
+        if (DeliveredSeq[ReadSeq & (kNumSlots-1)] != ReadSeq + 1)
+        {
+            Slot* slot = &Slots[ReadSeq & (kNumSlots-1)];
+            u32 tag = slot->Header.Tag.load(std::memory_order_acquire);
+            if (tag == 0 || (s32)(tag - (ReadSeq + 1)) < 0)
+                break;
+            if (tag == ReadSeq + 1 && slot->Header.SenderID != InstanceID)
+                break;
+        }
+
+        ReadSeq++;
+    }
+
+    return 0;
+}
+
+int RecvPacket(u8* data, bool block, u64 timestamp)
+{
+    if (!Header)
+        return 0;
+
+    // in sync mode, waiting is done by emulated time instead
+    if (SyncMode)
+        return RecvPacketSync(data, timestamp);
+
+    bool waited = false;
+    for (;;)
+    {
+        u32 published = Header->Published.load();
+        u32 claimed = Header->WriteClaim.load();
+
+        while (ReadSeq != claimed)
+        {
+            // if we fell behind by more than the whole ring, those packets are gone
+            if ((claimed - ReadSeq) > kNumSlots)
+                ReadSeq = claimed - kNumSlots;
+
+            Slot* slot = &Slots[ReadSeq & (kNumSlots-1)];
+            u32 tag = slot->Header.Tag.load(std::memory_order_acquire);
+            if (tag != ReadSeq + 1)
+            {
+                // still being written, wait for it to be published
+                if (tag == 0 || (s32)(tag - (ReadSeq + 1)) < 0)
+                    break;
+
+                // already overwritten by a newer packet
+                ReadSeq++;
+                continue;
+            }
+
+            u32 sender = slot->Header.SenderID;
+            u32 len = slot->Header.Length;
+            if (len > kMaxPacketLen) len = 0;
+            memcpy(data, slot->Data, len);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool torn = slot->Header.Tag.load(std::memory_order_relaxed) != tag;
+
+            ReadSeq++;
+
+            if (torn || sender == InstanceID || len < 24)
+                continue;
+
+            return len;
+        }
+
+        if (!block || waited)
+            return 0;
+
+        WaitOnWord(&Header->Published, published, 5000);
+        waited = true;
+    }
+}
+
+}
@@ -0,0 +1,40 @@
+/*
+    Copyright 2016-2020 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LOCALMP_H
+#define LOCALMP_H
+
+#include "../types.h"
+
+namespace LocalMP
+{
+
+// local multiplayer transport for instances running on the same machine.
+// packets go through a ring buffer in shared memory instead of UDP sockets.
+// in sync mode, instances also share their emulated time, and packets are
+// delivered at a fixed emulated delay after they were sent.
+
+bool Init(bool sync);
+void DeInit();
+
+int SendPacket(u8* data, int len, u64 timestamp);
+int RecvPacket(u8* data, bool block, u64 timestamp);
+
+}
+
+#endif // LOCALMP_H
@@ -29,6 +29,7 @@
 #include "PlatformConfig.h"
 #include "LAN_Socket.h"
 #include "LAN_PCap.h"
+#include "LocalMP.h"
 #include <string>
 
 #ifdef __WIN32__
@@ -72,6 +73,9 @@ socket_t MPSocket;
 sockaddr_t MPSendAddr;
 u8 PacketBuffer[2048];
 
+// whether the current MP session goes through LocalMP instead of UDP
+bool MPSharedMemory = false;
+
 #define NIFI_VER 1
 
 
@@ -206,6 +210,11 @@ void Thread_Wait(void* thread)
     ((QThread*) thread)->wait();
 }
 
+void Thread_Sleep(u32 msecs)
+{
+    QThread::msleep(msecs);
+}
+
 
 void* Semaphore_Create()
 {
@@ -246,6 +255,10 @@ bool MP_Init()
     int opt_true = 1;
     int res;
 
+    MPSharedMemory = (Config::MPSharedMemory != 0);
+    if (MPSharedMemory)
+        return LocalMP::Init(Config::MPSync != 0);
+
 #ifdef __WIN32__
     WSADATA wsadata;
     if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
@@ -297,6 +310,12 @@ bool MP_Init()
 
 void MP_DeInit()
 {
+    if (MPSharedMemory)
+    {
+        LocalMP::DeInit();
+        return;
+    }
+
     if (MPSocket >= 0)
         closesocket(MPSocket);
 
@@ -305,8 +324,11 @@ void MP_DeInit()
 #endif // __WIN32__
 }
 
-int MP_SendPacket(u8* data, int len)
+int MP_SendPacket(u8* data, int len, u64 timestamp)
 {
+    if (MPSharedMemory)
+        return LocalMP::SendPacket(data, len, timestamp);
+
     if (MPSocket < 0)
         return 0;
 
@@ -327,8 +349,11 @@ int MP_SendPacket(u8* data, int len)
     return slen - 8;
 }
 
-int MP_RecvPacket(u8* data, bool block)
+int MP_RecvPacket(u8* data, bool block, u64 timestamp)
 {
+    if (MPSharedMemory)
+        return LocalMP::RecvPacket(data, block, timestamp);
+
     if (MPSocket < 0)
         return 0;
 
@@ -49,6 +49,7 @@ int ScreenVSyncInterval;
 
 int _3DRenderer;
 int Threaded3D;
+int Threads3D;
 
 int GL_ScaleFactor;
 int GL_BetterPolygons;
@@ -61,6 +62,8 @@ int ConsoleType;
 int DirectBoot;
 
 int SocketBindAnyAddr;
+int MPSharedMemory;
+int MPSync;
 char LANDevice[128];
 int DirectLAN;
 
@@ -143,6 +146,7 @@ ConfigEntry PlatformConfigFile[] =
 
     {"3DRenderer", 0, &_3DRenderer, 0, NULL, 0},
     {"Threaded3D", 0, &Threaded3D, 1, NULL, 0},
+    {"Threads3D", 0, &Threads3D, 1, NULL, 0},
 
     {"GL_ScaleFactor", 0, &GL_ScaleFactor, 1, NULL, 0},
     {"GL_BetterPolygons", 0, &GL_BetterPolygons, 0, NULL, 0},
@@ -155,6 +159,8 @@ ConfigEntry PlatformConfigFile[] =
     {"DirectBoot", 0, &DirectBoot, 1, NULL, 0},
 
     {"SockBindAnyAddr", 0, &SocketBindAnyAddr, 0, NULL, 0},
+    {"MPSharedMemory", 0, &MPSharedMemory, 0, NULL, 0},
+    {"MPSync", 0, &MPSync, 0, NULL, 0},
     {"LANDevice", 1, LANDevice, 0, "", 127},
     {"DirectLAN", 0, &DirectLAN, 0, NULL, 0},
 
@@ -63,6 +63,7 @@ extern int ScreenVSyncInterval;
 
 extern int _3DRenderer;
 extern int Threaded3D;
+extern int Threads3D;
 
 extern int GL_ScaleFactor;
 extern int GL_BetterPolygons;
@@ -75,6 +76,8 @@ extern int ConsoleType;
 extern int DirectBoot;
 
 extern int SocketBindAnyAddr;
+extern int MPSharedMemory;
+extern int MPSync;
 extern char LANDevice[128];
 extern int DirectLAN;
 
@@ -57,6 +57,9 @@ WifiSettingsDialog::WifiSettingsDialog(QWidget* parent) : QDialog(parent), ui(ne
     ui->cbDirectMode->setText("Direct mode (requires " PCAP_NAME " and ethernet connection)");
 
     ui->cbBindAnyAddr->setChecked(Config::SocketBindAnyAddr != 0);
+    ui->cbSharedMemMP->setChecked(Config::MPSharedMemory != 0);
+    ui->cbSyncMP->setChecked(Config::MPSync != 0);
+    ui->cbSyncMP->setEnabled(Config::MPSharedMemory != 0);
     ui->cbRandomizeMAC->setChecked(Config::RandomizeMAC != 0);
 
     int sel = 0;
@@ -100,6 +103,8 @@ void WifiSettingsDialog::done(int r)
         }
 
         Config::SocketBindAnyAddr = ui->cbBindAnyAddr->isChecked() ? 1:0;
+        Config::MPSharedMemory = ui->cbSharedMemMP->isChecked() ? 1:0;
+        Config::MPSync = ui->cbSyncMP->isChecked() ? 1:0;
         Config::RandomizeMAC = randommac;
         Config::DirectLAN = ui->cbDirectMode->isChecked() ? 1:0;
 
@@ -125,6 +130,11 @@ void WifiSettingsDialog::done(int r)
     closeDlg();
 }
 
+void WifiSettingsDialog::on_cbSharedMemMP_stateChanged(int state)
+{
+    ui->cbSyncMP->setEnabled(state != 0);
+}
+
 void WifiSettingsDialog::on_cbDirectMode_stateChanged(int state)
 {
     updateAdapterControls();
@@ -55,6 +55,7 @@ public:
 private slots:
     void done(int r);
 
+    void on_cbSharedMemMP_stateChanged(int state);
     void on_cbDirectMode_stateChanged(int state);
     void on_cbxDirectAdapter_currentIndexChanged(int sel);
 
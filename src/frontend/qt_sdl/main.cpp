@@ -334,6 +334,7 @@ void EmuThread::run()
 
     videoSettingsDirty = false;
     videoSettings.Soft_Threaded = Config::Threaded3D != 0;
+    videoSettings.Soft_ThreadCount = Config::Threads3D;
     videoSettings.GL_ScaleFactor = Config::GL_ScaleFactor;
 
     if (hasOGL)
@@ -410,6 +411,7 @@ void EmuThread::run()
                 videoSettingsDirty = false;
 
                 videoSettings.Soft_Threaded = Config::Threaded3D != 0;
+                videoSettings.Soft_ThreadCount = Config::Threads3D;
                 videoSettings.GL_ScaleFactor = Config::GL_ScaleFactor;
                 videoSettings.GL_BetterPolygons = Config::GL_BetterPolygons;
 
@@ -521,14 +523,26 @@ void EmuThread::run()
                 u32 fps;
                 if (diff < 1) fps = 77777;
                 else fps = (nframes * 1000) / diff;
-                nframes = 0;
 
                 float fpstarget;
                 if (framerate < 1) fpstarget = 999;
                 else fpstarget = 1000.0f/framerate;
 
-                sprintf(melontitle, "[%d/%.0f] melonDS " MELONDS_VERSION, fps, fpstarget);
+                // share of the emulated time the CPUs spent in skipped idle loops
+                // (560190 cycles per frame)
+                u64 idle9, idle7;
+                NDS::GetIdleSkipCycles(&idle9, &idle7);
+                if (NDS::IdleSkip)
+                {
+                    u64 total = (u64)nframes * 560190;
+                    sprintf(melontitle, "[%d/%.0f] [idle %d%%/%d%%] melonDS " MELONDS_VERSION, fps, fpstarget,
+                            (int)((idle9 * 100) / total), (int)((idle7 * 100) / total));
+                }
+                else
+                    sprintf(melontitle, "[%d/%.0f] melonDS " MELONDS_VERSION, fps, fpstarget);
                 changeWindowTitle(melontitle);
+
+                nframes = 0;
             }
         }
         else
@@ -40,12 +40,28 @@ namespace Config
 
     int RandomizeMAC;
 
+    int SPU_BatchSize = 1;
+
+#ifdef HAVE_THREADS
+    int SaveFlushAsync = true;
+#else
+    int SaveFlushAsync = false;
+#endif
+
+    int ParallelCPUs = false;
+
+    int IdleSkip = false;
+    char IdleSkipGames[1024];
+
 #ifdef JIT_ENABLED
     int JIT_Enable = true;
     int JIT_MaxBlockSize = 12;
     int JIT_BranchOptimisations = true;
     int JIT_LiteralOptimisations = true;
     int JIT_FastMemory = false;
+    int JIT_PersistentCache = false;
+    int JIT_TieredCompilation = false;
+    int JIT_DecodeCache = true;
 #else
     // Needed for savestate
     int JIT_Enable = false;
@@ -58,6 +74,9 @@ namespace Config
         {"JIT_MaxBlockSize", 0, &JIT_MaxBlockSize, 10, NULL, 0},
         {"JIT_BranchOptimisations", 0, &JIT_BranchOptimisations, 1, NULL, 0},
         {"JIT_LiteralOptimisations", 0, &JIT_LiteralOptimisations, 1, NULL, 0},
+        {"JIT_PersistentCache", 0, &JIT_PersistentCache, 0, NULL, 0},
+        {"JIT_TieredCompilation", 0, &JIT_TieredCompilation, 0, NULL, 0},
+        {"JIT_DecodeCache", 0, &JIT_DecodeCache, 1, NULL, 0},
 #endif
 
         {"", -1, NULL, 0, NULL, 0}
@@ -106,7 +106,7 @@ bool ssem_trywait(ssem_t *semaphore)
    slock_lock(semaphore->mutex);
 
    bool positive = false;
-   if(semaphore->value)
+   if(semaphore->value > 0)
    {
       semaphore->value--;
       positive = true;
@@ -52,6 +52,9 @@ enum CurrentRenderer
 
 static CurrentRenderer current_renderer = CurrentRenderer::None;
 
+// size of a savestate for the currently loaded game, 0 if not yet measured
+static size_t serialize_size = 0;
+
 bool direct_boot = false;
 
 static void fallback_log(enum retro_log_level level, const char *fmt, ...)
@@ -161,8 +164,12 @@ void retro_set_environment(retro_environment_t cb)
       { "melonds_swapscreen_mode", "Swap Screen mode; Toggle|Hold" },
 #ifdef HAVE_THREADS
       { "melonds_threaded_renderer", "Threaded software renderer; disabled|enabled" },
+      { "melonds_renderer_threads", "Software renderer band threads; 1|2|3|4|6|8" },
+      { "melonds_parallel_cpus", "Run ARM7 on a separate thread; disabled|enabled" },
 #endif
       { "melonds_touch_mode", "Touch mode; disabled|Mouse|Touch|Joystick" },
+      { "melonds_audio_batch_size", "Audio mixing batch size; 1|4|8|16|32" },
+      { "melonds_idle_skip", "Interpreter idle loop skipping (Restart); disabled|enabled" },
 #ifdef HAVE_OPENGL
       { "melonds_opengl_renderer", "OpenGL Renderer (Restart); disabled|enabled" },
       { "melonds_opengl_resolution", opengl_resolution.c_str() },
@@ -172,6 +179,9 @@ void retro_set_environment(retro_environment_t cb)
       { "melonds_jit_block_size", jit_blocksize.c_str() },
       { "melonds_jit_branch_optimisations", "JIT Branch optimisations; enabled|disabled" },
       { "melonds_jit_literal_optimisations", "JIT Literal optimisations; enabled|disabled" },
+      { "melonds_jit_persistent_cache", "JIT Persistent cache; disabled|enabled" },
+      { "melonds_jit_tiered_compilation", "JIT Tiered compilation; disabled|enabled" },
+      { "melonds_jit_decode_cache", "Interpreter decode cache (JIT disabled); enabled|disabled" },
 #endif
       { 0, 0 }
    };
@@ -232,6 +242,7 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
 
 void retro_reset(void)
 {
+   serialize_size = 0;
    NDS::Reset();
    NDS::LoadROM(rom_path.c_str(), save_path.c_str(), direct_boot);
 }
@@ -292,6 +303,18 @@ static void check_variables(bool init)
       else
          video_settings.Soft_Threaded = false;
    }
+
+   var.key = "melonds_renderer_threads";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      video_settings.Soft_ThreadCount = std::stoi(var.value);
+   }
+
+   var.key = "melonds_parallel_cpus";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      Config::ParallelCPUs = !strcmp(var.value, "enabled");
+   }
 #endif
 
    TouchMode new_touch_mode = TouchMode::Disabled;
@@ -307,6 +330,18 @@ static void check_variables(bool init)
          new_touch_mode = TouchMode::Joystick;
    }
 
+   var.key = "melonds_audio_batch_size";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      Config::SPU_BatchSize = std::stoi(var.value);
+   }
+
+   var.key = "melonds_idle_skip";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      Config::IdleSkip = !strcmp(var.value, "enabled");
+   }
+
 #ifdef HAVE_OPENGL
    bool gl_update = false;
 
@@ -383,6 +418,33 @@ static void check_variables(bool init)
       else
          Config::JIT_LiteralOptimisations = false;
    }
+
+   var.key = "melonds_jit_persistent_cache";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_PersistentCache = true;
+      else
+         Config::JIT_PersistentCache = false;
+   }
+
+   var.key = "melonds_jit_tiered_compilation";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_TieredCompilation = true;
+      else
+         Config::JIT_TieredCompilation = false;
+   }
+
+   var.key = "melonds_jit_decode_cache";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_DecodeCache = true;
+      else
+         Config::JIT_DecodeCache = false;
+   }
 #endif
 
    input_state.current_touch_mode = new_touch_mode;
@@ -609,6 +671,7 @@ bool retro_load_game(const struct retro_game_info *info)
 
    GPU::SetRenderSettings(false, video_settings);
    NDS::SetConsoleType(0);
+   serialize_size = 0;
    NDS::LoadROM(rom_path.c_str(), save_path.c_str(), direct_boot);
 
    (void)info;
@@ -618,6 +681,7 @@ bool retro_load_game(const struct retro_game_info *info)
 
 void retro_unload_game(void)
 {
+   serialize_size = 0;
    NDS::DeInit();
 }
 
@@ -631,39 +695,43 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info *info,
    return false;
 }
 
-#define MAX_SERIALIZE_TEST_SIZE 16 * 1024 * 1024 // The current savestate is around 7MiB so 16MiB should be enough for now
-
 size_t retro_serialize_size(void)
 {
-   // Create the dummy savestate
-   void* data = malloc(MAX_SERIALIZE_TEST_SIZE);
-   Savestate* savestate = new Savestate(data, MAX_SERIALIZE_TEST_SIZE, true);
-   NDS::DoSavestate(savestate);
-   // Find the offset to find the current static filesize
-   size_t size = savestate->GetOffset();
-   // Free
-   delete savestate;
-   free(data);
+   // The savestate size only depends on the loaded game and console
+   // configuration, so measure it once with a dry run that doesn't copy anything
+   if (!serialize_size)
+   {
+      Savestate* savestate = new Savestate();
+      NDS::DoSavestate(savestate);
+      serialize_size = savestate->GetOffset();
+      delete savestate;
+   }
 
-   return size;
+   return serialize_size;
 }
 
 bool retro_serialize(void *data, size_t size)
 {
    Savestate* savestate = new Savestate(data, size, true);
    NDS::DoSavestate(savestate);
+   bool success = !savestate->Error;
    delete savestate;
 
-   return true;
+   // the state didn't fit, remeasure next time
+   if (!success)
+      serialize_size = 0;
+
+   return success;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
    Savestate* savestate = new Savestate((void*)data, size, false);
    NDS::DoSavestate(savestate);
+   bool success = !savestate->Error;
    delete savestate;
 
-   return true;
+   return success;
 }
 
 void *retro_get_memory_data(unsigned type)
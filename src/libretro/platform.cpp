@@ -31,6 +31,7 @@
 #include <rthreads/rsemaphore.h>
 #endif
 
+#include <retro_timers.h>
 #include <streams/file_stream.h>
 #include <streams/file_stream_transforms.h>
 
@@ -87,10 +88,15 @@ namespace Platform
    void Semaphore_Reset(void *sema)
    {
    #ifdef HAVE_THREADS
-      ssem_wait((ssem_t*)sema);
+      while (ssem_trywait((ssem_t*)sema));
    #endif
    }
 
+   void Thread_Sleep(u32 msecs)
+   {
+      retro_sleep(msecs);
+   }
+
    void Semaphore_Post(void *sema)
    {
    #ifdef HAVE_THREADS
@@ -126,9 +132,7 @@ namespace Platform
 
    void Thread_Free(void *thread)
    {
-   #if HAVE_THREADS
-      sthread_detach((sthread_t*)thread);
-   #endif
+      // sthread_join() in Thread_Wait() already released the thread
    }
 
    void *Thread_Create(void (*func)())
@@ -210,7 +214,7 @@ namespace Platform
 #endif // __WXMSW__
    }
 
-   int MP_SendPacket(u8* data, int len)
+   int MP_SendPacket(u8* data, int len, u64 timestamp)
    {
       if (MPSocket < 0)
       {
@@ -236,7 +240,7 @@ namespace Platform
 
    }
 
-   int MP_RecvPacket(u8* data, bool block)
+   int MP_RecvPacket(u8* data, bool block, u64 timestamp)
    {
       if (MPSocket < 0)
       {